@@ -0,0 +1,213 @@
+//affinity.c
+#define _GNU_SOURCE
+#include "affinity.h"
+#include "commands.h"
+#include "schedpolicy.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* placement_names[] = {
+	[PLACEMENT_OFF] = "off",
+	[PLACEMENT_ROUND_ROBIN] = "rr",
+	[PLACEMENT_LEAST_LOADED] = "least",
+};
+
+#define PLACEMENT_MODES_NUM ((int)(sizeof(placement_names) / sizeof(placement_names[0])))
+
+static PlacementMode placement_mode = PLACEMENT_OFF;
+static int placement_width = PLACEMENT_WIDTH_DEFAULT;
+static CpuSet shell_cpus;
+static CpuSet reserved_cpus;
+
+//the shell's cpus minus the reserved ones, in increasing order
+static int usable[CPU_SETSIZE];
+static int usable_num = 0;
+static int next_group = 0;  //round robin position in usable
+
+static int cpu_load[CPU_SETSIZE];
+
+static void updateUsable(void) {
+	usable_num = 0;
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu, &shell_cpus.set) && !CPU_ISSET(cpu, &reserved_cpus.set)) {
+			usable[usable_num++] = cpu;
+		}
+	}
+	next_group = 0;
+}
+
+void initPlacement(void) {
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &shell_cpus.set) == -1) {
+		CPU_ZERO(&shell_cpus.set);
+		CPU_SET(0, &shell_cpus.set);
+	}
+	CPU_ZERO(&reserved_cpus.set);
+	updateUsable();
+
+	const char* mode = getenv("SMASH_PLACEMENT");
+	if(mode && !parsePlacementMode(mode, &placement_mode)) {
+		perrorSmash("SMASH_PLACEMENT", "invalid value, using default");
+	}
+}
+
+bool setPlacement(PlacementMode mode, int width, const CpuSet* reserved) {
+	CpuSet saved = reserved_cpus;
+	reserved_cpus = *reserved;
+	updateUsable();
+	if(usable_num == 0) {
+		reserved_cpus = saved;
+		updateUsable();
+		return false;
+	}
+	placement_mode = mode;
+	placement_width = width;
+	return true;
+}
+
+void printPlacement(void) {
+	printf("placement %s width %d reserved ", placement_names[placement_mode], placement_width);
+	printCpuList(&reserved_cpus);
+	printf(" background ");
+	CpuSet background;
+	CPU_ZERO(&background.set);
+	for(int i = 0; i < usable_num; i++) {
+		CPU_SET(usable[i], &background.set);
+	}
+	printCpuList(&background);
+	printf("\n");
+}
+
+bool parsePlacementMode(const char* name, PlacementMode* mode) {
+	for(int i = 0; i < PLACEMENT_MODES_NUM; i++) {
+		if(strcmp(name, placement_names[i]) == 0) {
+			*mode = (PlacementMode)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static int groupLoad(int start, int width) {
+	int load = 0;
+	for(int k = 0; k < width; k++) {
+		load += cpu_load[usable[(start + k) % usable_num]];
+	}
+	return load;
+}
+
+bool placeJob(CpuSet* cpus) {
+	if(placement_mode == PLACEMENT_OFF || usable_num == 0) {
+		return false;
+	}
+	int width = placement_width < usable_num ? placement_width : usable_num;
+
+	int start = 0;
+	if(placement_mode == PLACEMENT_ROUND_ROBIN) {
+		start = next_group;
+		next_group = (next_group + width) % usable_num;
+	} else {
+		int best = -1;
+		for(int group = 0; group < usable_num; group += width) {
+			int load = groupLoad(group, width);
+			if(best == -1 || load < best) {
+				best = load;
+				start = group;
+			}
+		}
+	}
+
+	CPU_ZERO(&cpus->set);
+	for(int k = 0; k < width; k++) {
+		CPU_SET(usable[(start + k) % usable_num], &cpus->set);
+	}
+	return true;
+}
+
+void takeCpus(const CpuSet* cpus) {
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu, &cpus->set)) {
+			cpu_load[cpu]++;
+		}
+	}
+}
+
+void releaseCpus(const CpuSet* cpus) {
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu, &cpus->set) && cpu_load[cpu] > 0) {
+			cpu_load[cpu]--;
+		}
+	}
+}
+
+const CpuSet* shellCpus(void) {
+	return &shell_cpus;
+}
+
+static bool pinThread(pid_t tid, const void* arg) {
+	const CpuSet* cpus = arg;
+	return sched_setaffinity(tid, sizeof(cpu_set_t), &cpus->set) == 0;
+}
+
+bool pinProcess(pid_t pid, const CpuSet* cpus) {
+	return forEachThread(pid, pinThread, cpus);
+}
+
+bool getProcessCpus(pid_t pid, CpuSet* cpus) {
+	return sched_getaffinity(pid, sizeof(cpu_set_t), &cpus->set) == 0;
+}
+
+bool parseCpuList(const char* list, CpuSet* cpus) {
+	CPU_ZERO(&cpus->set);
+	const char* p = list;
+	while(*p) {
+		char* end;
+		long first = strtol(p, &end, 10);
+		if(end == p || first < 0 || first >= CPU_SETSIZE) {
+			return false;
+		}
+		long last = first;
+		if(*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if(end == p || last < first || last >= CPU_SETSIZE) {
+				return false;
+			}
+		}
+		for(long cpu = first; cpu <= last; cpu++) {
+			CPU_SET(cpu, &cpus->set);
+		}
+		if(*end == ',') {
+			end++;
+			if(!*end) {
+				return false;
+			}
+		} else if(*end) {
+			return false;
+		}
+		p = end;
+	}
+	return true;
+}
+
+void printCpuList(const CpuSet* cpus) {
+	bool first = true;
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(!CPU_ISSET(cpu, &cpus->set)) {
+			continue;
+		}
+		int last = cpu;
+		while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus->set)) {
+			last++;
+		}
+		printf(first ? "%d" : ",%d", cpu);
+		if(last > cpu) {
+			printf("-%d", last);
+		}
+		first = false;
+		cpu = last;
+	}
+	if(first) {
+		printf("none");
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <sched.h>
+#include <sys/types.h>
+
+//cpus a background job gets unless told otherwise
+#define PLACEMENT_WIDTH_DEFAULT 1
+
+/*=============================================================================
+* cpu placement of background jobs
+*
+* the cpus the shell may run on, minus a reserved set kept free for the
+* foreground job, are cut into consecutive groups of width cpus. every new
+* background job is pinned to one group, taken in turn (round robin) or the
+* one with the fewest background jobs on it (least loaded). foreground jobs
+* keep the shell's own mask. placement is off unless SMASH_PLACEMENT or the
+* placement builtin turn it on.
+=============================================================================*/
+typedef enum {
+	PLACEMENT_OFF,
+	PLACEMENT_ROUND_ROBIN,
+	PLACEMENT_LEAST_LOADED
+} PlacementMode;
+
+//wrapped so jobs.h can hold one without needing _GNU_SOURCE
+typedef struct CpuSet {
+	cpu_set_t set;
+} CpuSet;
+
+/*
+ * takes the usable cpus from the shell's own mask, and the mode from the
+ * SMASH_PLACEMENT environment variable, if set
+ */
+void initPlacement(void);
+
+/*
+ * returns false if reserved leaves no cpu for background jobs
+ */
+bool setPlacement(PlacementMode mode, int width, const CpuSet* reserved);
+void printPlacement(void);
+bool parsePlacementMode(const char* name, PlacementMode* mode);
+
+/*
+ * picks the cpus of a new background job, false if placement is off
+ */
+bool placeJob(CpuSet* cpus);
+
+//background jobs on each cpu, what least loaded goes by
+void takeCpus(const CpuSet* cpus);
+void releaseCpus(const CpuSet* cpus);
+
+//the mask the shell started with, what foreground jobs run on
+const CpuSet* shellCpus(void);
+
+/*
+ * pins every thread of process pid to cpus. returns false if any failed
+ */
+bool pinProcess(pid_t pid, const CpuSet* cpus);
+
+bool getProcessCpus(pid_t pid, CpuSet* cpus);
+
+/*
+ * lists like 0-3,8,10-11
+ */
+bool parseCpuList(const char* list, CpuSet* cpus);
+void printCpuList(const CpuSet* cpus);
+
+#endif //AFFINITY_H
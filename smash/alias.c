@@ -0,0 +1,257 @@
+//alias.c
+#define _GNU_SOURCE
+#include "alias.h"
+#include "commands.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define INITIAL_TABLE_SIZE 16
+
+static Alias** table = NULL; //open addressing, linear probing
+static size_t table_size = 0;
+static size_t alias_count = 0;
+static Alias* alias_list = NULL;
+static unsigned long alias_version = 0;
+
+//expansion bookkeeping, chain is reused between expansions
+static unsigned long expansion_pass = 0;
+static Alias** chain = NULL;
+static size_t chain_size = 0;
+
+static size_t hashName(const char* name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h & (table_size - 1);
+}
+
+static char* copyString(const char* str) {
+    size_t len = strlen(str);
+    char* copy = MALLOC_VALIDATED(char, len + 1);
+    memcpy(copy, str, len + 1);
+    return copy;
+}
+
+//lexes command the way a command line is lexed, an unterminated quote leaves no tokens
+static void tokenizeAlias(Alias* alias) {
+    arenaFree(&alias->storage);
+    char* text = arenaStrdup(&alias->storage, alias->command);
+    if (lexLine(&alias->storage, text, &alias->tokens) != VALID_COMMAND) {
+        alias->tokens.tokens_num = 0;
+    }
+}
+
+static Alias** lookupSlot(const char* name, size_t len) {
+    size_t i = hashName(name, len);
+    while (table[i]) {
+        if (strncmp(table[i]->alias, name, len) == 0 && table[i]->alias[len] == '\0') {
+            return &table[i];
+        }
+        i = (i + 1) & (table_size - 1);
+    }
+    return &table[i];
+}
+
+static void insertEntry(Alias* alias) {
+    *lookupSlot(alias->alias, strlen(alias->alias)) = alias;
+}
+
+static void growTable(void) {
+    Alias** old = table;
+    size_t old_size = table_size;
+
+    table_size = table_size ? table_size * 2 : INITIAL_TABLE_SIZE;
+    table = calloc(table_size, sizeof(Alias*));
+    if (!table) ERROR_EXIT("calloc");
+
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i]) insertEntry(old[i]);
+    }
+    free(old);
+}
+
+static Alias* findAliasN(const char* name, size_t len) {
+    if (!table_size) return NULL;
+    return *lookupSlot(name, len);
+}
+
+Alias* findAlias(const char* name) {
+    return findAliasN(name, strlen(name));
+}
+
+void addAlias(const char* name, const char* command) {
+    alias_version++;
+
+    //checks for alias
+    Alias* found = findAlias(name);
+    if (found) {
+
+        //found so replaces the command of the alias
+        free(found->command);
+        found->command = copyString(command);
+        tokenizeAlias(found);
+        return;
+    }
+
+    //didnt find the alias so created a new ALIAS
+    if (2 * (alias_count + 1) > table_size) growTable();
+
+    Alias* new_alias = MALLOC_VALIDATED(Alias, sizeof(Alias));
+    memset(new_alias, 0, sizeof(Alias));
+    new_alias->alias = copyString(name);
+    new_alias->command = copyString(command);
+    tokenizeAlias(new_alias);
+
+    new_alias->next = alias_list;
+    if (alias_list) alias_list->prev = new_alias;
+    alias_list = new_alias;
+
+    insertEntry(new_alias);
+    alias_count++;
+}
+
+bool removeAlias(const char* name) {
+    if (!table_size) return false;
+
+    Alias** slot = lookupSlot(name, strlen(name));
+    Alias* alias = *slot;
+    if (!alias) return false;
+    alias_version++;
+
+    //backward shift deletion keeps probe chains intact without tombstones
+    size_t i = slot - table;
+    size_t j = i;
+    table[i] = NULL;
+    while (1) {
+        j = (j + 1) & (table_size - 1);
+        if (!table[j]) break;
+        size_t home = hashName(table[j]->alias, strlen(table[j]->alias));
+        bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            table[i] = table[j];
+            table[j] = NULL;
+            i = j;
+        }
+    }
+
+    if (alias->prev) alias->prev->next = alias->next;
+    else alias_list = alias->next;
+    if (alias->next) alias->next->prev = alias->prev;
+    alias_count--;
+
+    free(alias->alias);
+    free(alias->command);
+    arenaFree(&alias->storage);
+    free(alias);
+    return true;
+}
+
+void clearAliases(void) {
+    while (alias_list) removeAlias(alias_list->alias);
+    free(table);
+    free(chain);
+    table = NULL;
+    chain = NULL;
+    table_size = 0;
+    chain_size = 0;
+}
+
+unsigned long aliasVersion(void) {
+    return alias_version;
+}
+
+Alias* firstAlias(void) {
+    return alias_list;
+}
+
+//an alias token in place of the word at span, the word itself goes to arena
+static void copyToken(Arena* arena, Token* to, const Token* from, const Token* span) {
+    *to = *from;
+    if (from->type == TOKEN_WORD) {
+        to->word = arenaStrdup(arena, from->word);
+    }
+    to->start = span->start;
+    to->end = span->end;
+}
+
+static bool isAliasCandidate(const Token* token) {
+    return token->type == TOKEN_WORD && !token->quoted;
+}
+
+//the alias chain of tokens[i] in place of it, returns the number of tokens put there
+static int expandWord(Arena* arena, TokenList* list, int i, size_t chain_len) {
+    const Alias* innermost = chain[chain_len - 1];
+    int added = innermost->tokens.tokens_num;
+    for (size_t c = 0; c + 1 < chain_len; c++) {
+        added += chain[c]->tokens.tokens_num - 1;
+    }
+
+    const int tokens_num = list->tokens_num - 1 + added;
+    Token* tokens = arenaAlloc(arena, (tokens_num ? tokens_num : 1) * sizeof(Token));
+    const Token* span = &list->tokens[i];
+    memcpy(tokens, list->tokens, i * sizeof(Token));
+
+    //innermost expansion, then the arguments each outer alias added, then the rest
+    int k = i;
+    for (int t = 0; t < innermost->tokens.tokens_num; t++) {
+        copyToken(arena, &tokens[k++], &innermost->tokens.tokens[t], span);
+    }
+    for (size_t c = chain_len - 1; c > 0; c--) {
+        const TokenList* outer = &chain[c - 1]->tokens;
+        for (int t = 1; t < outer->tokens_num; t++) {
+            copyToken(arena, &tokens[k++], &outer->tokens[t], span);
+        }
+    }
+    memcpy(tokens + k, list->tokens + i + 1, (list->tokens_num - i - 1) * sizeof(Token));
+
+    list->tokens = tokens;
+    list->tokens_num = tokens_num;
+    return added;
+}
+
+AliasExpansion expandAliases(Arena* arena, TokenList* list) {
+    AliasExpansion result = ALIAS_NONE;
+    bool command_start = true;
+
+    for (int i = 0; i < list->tokens_num; i++) {
+        const Token* token = &list->tokens[i];
+        if (token->type != TOKEN_WORD) {
+            command_start = token->type == TOKEN_PIPE || token->type == TOKEN_AND;
+            continue;
+        }
+        if (!command_start) continue;
+        command_start = false;
+
+        Alias* alias = isAliasCandidate(token) ? findAlias(token->word) : NULL;
+        if (!alias) continue;
+
+        //walk the chain first word -> alias -> alias..., a name already in the
+        //chain is taken literally, so alias ls='ls -d' runs the real ls
+        if (chain_size < alias_count) {
+            chain_size = alias_count;
+            chain = realloc(chain, chain_size * sizeof(Alias*));
+            if (!chain) ERROR_EXIT("realloc");
+        }
+        expansion_pass++;
+        size_t chain_len = 0;
+        while (alias) {
+            alias->visit = expansion_pass;
+            chain[chain_len++] = alias;
+            if (alias->tokens.tokens_num == 0 || !isAliasCandidate(&alias->tokens.tokens[0])) break;
+            alias = findAlias(alias->tokens.tokens[0].word);
+            if (alias && alias->visit == expansion_pass) break;
+        }
+
+        //the expansion itself is not expanded again, but may start a new command
+        int added = expandWord(arena, list, i, chain_len);
+        i += added - 1;
+        if (added > 0) {
+            TokenType last = list->tokens[i].type;
+            command_start = last == TOKEN_PIPE || last == TOKEN_AND;
+        }
+        result = ALIAS_EXPANDED;
+    }
+    return result;
+}
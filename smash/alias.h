@@ -0,0 +1,51 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "parser.h"
+
+/*=============================================================================
+* alias table
+*
+* aliases live in an open addressing hash table keyed by name. each entry keeps
+* its expansion already lexed, so expanding a command is one walk down the
+* alias chain of its first word and splicing the tokens into the line's.
+=============================================================================*/
+typedef struct Alias {
+    char* alias;
+    char* command;       //as given, for printing
+    Arena storage;       //the lexed command lives here
+    TokenList tokens;
+    unsigned long visit; //expansion pass that last visited this alias
+    struct Alias* prev;  //listing order, newest first
+    struct Alias* next;
+} Alias;
+
+typedef enum {
+    ALIAS_NONE,     //no command starts with an alias, the tokens are untouched
+    ALIAS_EXPANDED
+} AliasExpansion;
+
+Alias* findAlias(const char* name);
+void addAlias(const char* name, const char* command);
+bool removeAlias(const char* name);
+void clearAliases(void);
+
+//changes whenever an alias is added, replaced or removed
+unsigned long aliasVersion(void);
+
+//iteration in listing order
+Alias* firstAlias(void);
+
+/*
+ * replaces the first word of every command in list (at the start, after &&
+ * or |) by its alias chain, unless it is quoted. the new tokens come from arena
+ */
+AliasExpansion expandAliases(Arena* arena, TokenList* list);
+
+#endif //ALIAS_H
@@ -0,0 +1,100 @@
+//arena.c
+#include "arena.h"
+#include "commands.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_ALIGN (sizeof(void*) > sizeof(long double) ? sizeof(void*) : sizeof(long double))
+
+static ArenaBlock* newBlock(size_t size) {
+	ArenaBlock* block = MALLOC_VALIDATED(ArenaBlock, sizeof(ArenaBlock) + size);
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+void* arenaAlloc(Arena* arena, size_t size) {
+	if(!arena->current) {
+		arena->first = arena->current = newBlock(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+	}
+
+	while(1) {
+		ArenaBlock* block = arena->current;
+		size_t start = (block->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+		if(start + size <= block->size) {
+			block->used = start + size;
+			return block->data + start;
+		}
+
+		//reuse the blocks kept by a reset when they are big enough
+		if(block->next && block->next->size >= size) {
+			arena->current = block->next;
+			arena->current->used = 0;
+			continue;
+		}
+
+		size_t grown = block->size * 2;
+		ArenaBlock* fresh = newBlock(size > grown ? size : grown);
+		fresh->next = block->next;
+		block->next = fresh;
+		arena->current = fresh;
+	}
+}
+
+char* arenaStrndup(Arena* arena, const char* str, size_t len) {
+	char* copy = arenaAlloc(arena, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+char* arenaStrdup(Arena* arena, const char* str) {
+	return arenaStrndup(arena, str, strlen(str));
+}
+
+char* arenaPrintf(Arena* arena, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	char* str = arenaAlloc(arena, len + 1);
+	va_start(args, format);
+	vsnprintf(str, len + 1, format, args);
+	va_end(args);
+	return str;
+}
+
+ArenaMark arenaMark(const Arena* arena) {
+	ArenaMark mark = { arena->current, arena->current ? arena->current->used : 0 };
+	return mark;
+}
+
+void arenaRelease(Arena* arena, ArenaMark mark) {
+	if(!mark.block) {
+		arenaReset(arena);
+		return;
+	}
+	arena->current = mark.block;
+	mark.block->used = mark.used;
+}
+
+void arenaReset(Arena* arena) {
+	arena->current = arena->first;
+	if(arena->first) {
+		arena->first->used = 0;
+	}
+}
+
+void arenaFree(Arena* arena) {
+	ArenaBlock* block = arena->first;
+	while(block) {
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->first = arena->current = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef ARENA_H
+#define ARENA_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stddef.h>
+
+//size of the first block, later blocks double up to fit large requests
+#define ARENA_BLOCK_SIZE 4096
+
+/*=============================================================================
+* bump arena
+*
+* everything that lives for one command line (the raw line, its copies, the
+* tokens and argv arrays) is bump allocated from an arena and released all at
+* once, so lines and argument lists have no fixed limit and cost no malloc
+* per token. marks allow nested scopes, e.g. a builtin that runs commands.
+=============================================================================*/
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* first;
+    ArenaBlock* current;
+} Arena;
+
+typedef struct {
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+void* arenaAlloc(Arena* arena, size_t size);
+char* arenaStrndup(Arena* arena, const char* str, size_t len);
+char* arenaStrdup(Arena* arena, const char* str);
+char* arenaPrintf(Arena* arena, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+ArenaMark arenaMark(const Arena* arena);
+void arenaRelease(Arena* arena, ArenaMark mark);
+
+/*
+ * releases everything but keeps the blocks for the next line
+ */
+void arenaReset(Arena* arena);
+void arenaFree(Arena* arena);
+
+#endif //ARENA_H
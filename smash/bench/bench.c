@@ -0,0 +1,427 @@
+//bench.c
+#define _GNU_SOURCE
+
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "alias.h"
+#include "builtins.h"
+#include "commands.h"
+#include "filecmp.h"
+#include "jobs.h"
+#include "parser.h"
+#include "spawn.h"
+
+/*=============================================================================
+* microbenchmarks of the shell's hot paths
+*
+* every case runs its operation in batches that double until one batch takes
+* at least the minimum time (-t, 0.2s by default), and reports that batch as
+* one tab separated line:
+*   benchmark  size  iterations  ns_per_op  ops_per_sec  bytes_per_sec
+* size is what the case scales with (commands in the line, jobs or aliases
+* in the table, bytes per file, memory the parent touched before forking),
+* bytes_per_sec is 0 where there is no byte count. arguments other than -t
+* are prefixes, only the benchmarks that start with one of them run.
+=============================================================================*/
+#define DEFAULT_MIN_SECS 0.2
+#define MAX_ITERATIONS (1L << 30)
+
+//an operation run iterations times in a row, state is set up by the case
+typedef void (*BenchOp)(void* state, long iterations);
+
+static double min_secs = DEFAULT_MIN_SECS;
+static char** filters = NULL;
+static int filters_num = 0;
+
+//results end up here so the compiler cannot drop the work
+static volatile unsigned long sink;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool selected(const char* name) {
+	if(filters_num == 0) {
+		return true;
+	}
+	for(int i = 0; i < filters_num; i++) {
+		if(strncmp(name, filters[i], strlen(filters[i])) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * times op on state and prints its line. bytes is what one operation
+ * processes, 0 if that means nothing for the case
+ */
+static void runBench(const char* name, long size, long bytes, BenchOp op, void* state) {
+	long iterations = 1;
+	double secs;
+	while(1) {
+		double start = now();
+		op(state, iterations);
+		secs = now() - start;
+		if(secs >= min_secs || iterations >= MAX_ITERATIONS) {
+			break;
+		}
+		//aim straight for the minimum once a batch is long enough to measure
+		long next = secs > min_secs / 100 ? (long)(iterations * 1.2 * min_secs / secs) : iterations * 2;
+		iterations = next > iterations ? next : iterations * 2;
+	}
+	const double ops = iterations / secs;
+	printf("%s\t%ld\t%ld\t%.1f\t%.1f\t%.1f\n", name, size, iterations, secs * 1e9 / iterations, ops, ops * bytes);
+	fflush(stdout);
+}
+
+/*=============================================================================
+* parsing
+=============================================================================*/
+typedef struct {
+	const char* line;
+	size_t len;
+	Arena arena;
+	bool aliases; //expand aliases between lexing and parsing, like the shell
+} ParseState;
+
+static void parseOp(void* arg, long iterations) {
+	ParseState* state = arg;
+	for(long i = 0; i < iterations; i++) {
+		//parsing writes into the line, so every round gets a fresh copy
+		char* line = arenaStrndup(&state->arena, state->line, state->len);
+		TokenList tokens;
+		CommandList list;
+		if(lexLine(&state->arena, line, &tokens) != VALID_COMMAND) {
+			ERROR_EXIT("bench: parsing failed");
+		}
+		if(state->aliases) {
+			expandAliases(&state->arena, &tokens);
+		}
+		if(parseTokens(&state->arena, &tokens, &list) != VALID_COMMAND) {
+			ERROR_EXIT("bench: parsing failed");
+		}
+		sink += list.commands_num;
+		arenaReset(&state->arena);
+	}
+}
+
+//commands pipelines joined by &&, with quoting and a trailing &
+static char* benchLine(int commands) {
+	static const char* const command = "ll -a 'some dir' \"x y\" | grep -v foo | wc -l";
+	char* line = MALLOC_VALIDATED(char, commands * (strlen(command) + 4) + 3);
+	line[0] = '\0';
+	for(int i = 0; i < commands; i++) {
+		if(i > 0) {
+			strcat(line, " && ");
+		}
+		strcat(line, command);
+	}
+	strcat(line, " &");
+	return line;
+}
+
+static void benchParsing(void) {
+	static const int sizes[] = { 1, 8, 64 };
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		ParseState state = { .arena = {0} };
+		char* line = benchLine(sizes[i]);
+		state.line = line;
+		state.len = strlen(line);
+		if(selected("parse/line")) {
+			runBench("parse/line", sizes[i], state.len, parseOp, &state);
+		}
+		addAlias("ll", "ls -l");
+		state.aliases = true;
+		if(selected("parse/aliased")) {
+			runBench("parse/aliased", sizes[i], state.len, parseOp, &state);
+		}
+		clearAliases();
+		arenaFree(&state.arena);
+		free(line);
+	}
+}
+
+/*=============================================================================
+* aliases and builtins
+=============================================================================*/
+typedef struct {
+	char** names;
+	int names_num;
+} LookupState;
+
+static void aliasOp(void* arg, long iterations) {
+	LookupState* state = arg;
+	int j = 0;
+	for(long i = 0; i < iterations; i++) {
+		sink += (unsigned long)findAlias(state->names[j]);
+		if(++j == state->names_num) {
+			j = 0;
+		}
+	}
+}
+
+static void builtinOp(void* arg, long iterations) {
+	LookupState* state = arg;
+	int j = 0;
+	for(long i = 0; i < iterations; i++) {
+		sink += (unsigned long)findBuiltin(state->names[j]);
+		if(++j == state->names_num) {
+			j = 0;
+		}
+	}
+}
+
+static void benchAliases(void) {
+	static const int sizes[] = { 16, 1024, 65536 };
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		const int n = sizes[i];
+		LookupState hits = { MALLOC_VALIDATED(char*, n * sizeof(char*)), n };
+		LookupState misses = { MALLOC_VALIDATED(char*, n * sizeof(char*)), n };
+		for(int j = 0; j < n; j++) {
+			hits.names[j] = MALLOC_VALIDATED(char, 24);
+			misses.names[j] = MALLOC_VALIDATED(char, 24);
+			sprintf(hits.names[j], "alias%d", j);
+			sprintf(misses.names[j], "other%d", j);
+			addAlias(hits.names[j], "echo hello world");
+		}
+		if(selected("alias/hit")) {
+			runBench("alias/hit", n, 0, aliasOp, &hits);
+		}
+		if(selected("alias/miss")) {
+			runBench("alias/miss", n, 0, aliasOp, &misses);
+		}
+		clearAliases();
+		for(int j = 0; j < n; j++) {
+			free(hits.names[j]);
+			free(misses.names[j]);
+		}
+		free(hits.names);
+		free(misses.names);
+	}
+}
+
+static void benchBuiltins(void) {
+#define BUILTIN_NAME(name, handler, flags) #name,
+	static char* builtin_names[] = { BUILTIN_LIST(BUILTIN_NAME) };
+#undef BUILTIN_NAME
+	//what an interactive session runs most besides builtins
+	static char* external_names[] = { "ls", "grep", "cat", "make", "git", "sleep", "echo", "vim" };
+
+	LookupState hits = { builtin_names, sizeof(builtin_names) / sizeof(builtin_names[0]) };
+	LookupState misses = { external_names, sizeof(external_names) / sizeof(external_names[0]) };
+	if(selected("builtin/hit")) {
+		runBench("builtin/hit", hits.names_num, 0, builtinOp, &hits);
+	}
+	if(selected("builtin/miss")) {
+		runBench("builtin/miss", misses.names_num, 0, builtinOp, &misses);
+	}
+}
+
+/*=============================================================================
+* job table
+=============================================================================*/
+typedef struct {
+	int jobs;
+	pid_t first_pid;
+} JobsState;
+
+//a job is added and removed again with jobs others in the table
+static void jobAddOp(void* arg, long iterations) {
+	JobsState* state = arg;
+	for(long i = 0; i < iterations; i++) {
+		int job_id = addJob(state->first_pid + state->jobs, "sleep 100", BACKGROUND);
+		if(job_id < 0) {
+			ERROR_EXIT("bench: job table is full");
+		}
+		removeJobById(job_id);
+	}
+}
+
+static void jobFindOp(void* arg, long iterations) {
+	JobsState* state = arg;
+	int job_id = 0;
+	for(long i = 0; i < iterations; i++) {
+		sink += (unsigned long)findJobById(job_id);
+		if(++job_id == state->jobs) {
+			job_id = 0;
+		}
+	}
+}
+
+static void jobPidOp(void* arg, long iterations) {
+	JobsState* state = arg;
+	int j = 0;
+	for(long i = 0; i < iterations; i++) {
+		sink += (unsigned long)findJobByPid(state->first_pid + j);
+		if(++j == state->jobs) {
+			j = 0;
+		}
+	}
+}
+
+static void jobMaxOp(void* arg, long iterations) {
+	(void)arg;
+	for(long i = 0; i < iterations; i++) {
+		sink += (unsigned long)findMaxIdJobForFG();
+	}
+}
+
+static void benchJobs(void) {
+	static const int sizes[] = { 1, 100, 10000 };
+	setJobsLimit(INT_MAX);
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		//pids above any real one, nothing is ever sent to them
+		JobsState state = { sizes[i], 1 << 24 };
+		for(int j = 0; j < state.jobs; j++) {
+			addJob(state.first_pid + j, "sleep 100", BACKGROUND);
+		}
+		if(selected("jobs/add")) {
+			runBench("jobs/add", state.jobs, 0, jobAddOp, &state);
+		}
+		if(selected("jobs/find")) {
+			runBench("jobs/find", state.jobs, 0, jobFindOp, &state);
+		}
+		if(selected("jobs/pid")) {
+			runBench("jobs/pid", state.jobs, 0, jobPidOp, &state);
+		}
+		if(selected("jobs/max")) {
+			runBench("jobs/max", state.jobs, 0, jobMaxOp, &state);
+		}
+		clearJobs();
+	}
+}
+
+/*=============================================================================
+* file comparison
+=============================================================================*/
+typedef struct {
+	char path1[PATH_MAX];
+	char path2[PATH_MAX];
+} FilesState;
+
+static void filesOp(void* arg, long iterations) {
+	FilesState* state = arg;
+	for(long i = 0; i < iterations; i++) {
+		if(!areFilesEqual(state->path1, state->path2)) {
+			ERROR_EXIT("bench: equal files compared as different");
+		}
+	}
+}
+
+static void writeFile(char* path, long size) {
+	int fd = mkstemp(path);
+	if(fd == -1) {
+		ERROR_EXIT("bench: mkstemp");
+	}
+	char block[64 * 1024];
+	for(size_t i = 0; i < sizeof(block); i++) {
+		block[i] = (char)(i * 31 + 7);
+	}
+	for(long written = 0; written < size; ) {
+		long n = size - written < (long)sizeof(block) ? size - written : (long)sizeof(block);
+		ssize_t res = write(fd, block, n);
+		if(res <= 0) {
+			ERROR_EXIT("bench: write");
+		}
+		written += res;
+	}
+	close(fd);
+}
+
+static void benchFiles(void) {
+	//the last size takes the multithreaded path
+	static const long sizes[] = { 4096, 1024 * 1024, 16 * 1024 * 1024, FILECMP_PARALLEL_MIN };
+	const char* dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if(!selected("diff/equal")) {
+			return;
+		}
+		FilesState state;
+		snprintf(state.path1, sizeof(state.path1), "%s/smash_bench_XXXXXX", dir);
+		snprintf(state.path2, sizeof(state.path2), "%s/smash_bench_XXXXXX", dir);
+		writeFile(state.path1, sizes[i]);
+		writeFile(state.path2, sizes[i]);
+		runBench("diff/equal", sizes[i], sizes[i], filesOp, &state);
+		unlink(state.path1);
+		unlink(state.path2);
+	}
+}
+
+/*=============================================================================
+* process creation
+=============================================================================*/
+static void spawnOp(void* arg, long iterations) {
+	(void)arg;
+	static char* argv[] = { "true", NULL };
+	const SpawnOptions options = SPAWN_OPTIONS_DEFAULT;
+	for(long i = 0; i < iterations; i++) {
+		pid_t pid = spawnCommand(NULL, argv, "true", &options);
+		if(pid == -1) {
+			ERROR_EXIT("bench: spawn failed");
+		}
+		waitpid(pid, NULL, 0);
+	}
+}
+
+static void benchSpawn(void) {
+	//fork copies the page tables, so it is measured with more memory mapped too
+	static const long sizes[] = { 0, 256L * 1024 * 1024 };
+	static const SpawnMode modes[] = { SPAWN_FORK, SPAWN_POSIX_SPAWN, SPAWN_VFORK };
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		char* memory = NULL;
+		if(sizes[i] > 0) {
+			memory = MALLOC_VALIDATED(char, sizes[i]);
+			memset(memory, 1, sizes[i]);
+		}
+		for(size_t j = 0; j < sizeof(modes) / sizeof(modes[0]); j++) {
+			char name[64];
+			snprintf(name, sizeof(name), "spawn/%s", spawnModeName(modes[j]));
+			if(selected(name)) {
+				setSpawnMode(modes[j]);
+				runBench(name, sizes[i], 0, spawnOp, NULL);
+			}
+		}
+		free(memory);
+	}
+	setSpawnMode(SPAWN_MODE_DEFAULT);
+}
+
+/*=============================================================================
+* main function
+=============================================================================*/
+int main(int argc, char* argv[])
+{
+	int first = 1;
+	if(argc > 2 && strcmp(argv[1], "-t") == 0) {
+		min_secs = atof(argv[2]);
+		first = 3;
+	}
+	if(min_secs <= 0 || (argc > 1 && strcmp(argv[1], "-t") == 0 && first == 1)) {
+		fprintf(stderr, "usage: %s [-t min_secs] [benchmark_prefix...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	filters = argv + first;
+	filters_num = argc - first;
+
+	initJobs();
+	initBuiltins();
+	printf("benchmark\tsize\titerations\tns_per_op\tops_per_sec\tbytes_per_sec\n");
+	benchParsing();
+	benchAliases();
+	benchBuiltins();
+	benchJobs();
+	benchFiles();
+	benchSpawn();
+	return 0;
+}
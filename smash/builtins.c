@@ -0,0 +1,52 @@
+//builtins.c
+#include "builtins.h"
+
+#include <string.h>
+
+//power of two, at least twice the number of builtins
+#define BUILTIN_INDEX_SIZE 64
+
+#define REGISTER_BUILTIN(name, handler, flags) { #name, handler, flags },
+static const Builtin builtins[] = {
+    BUILTIN_LIST(REGISTER_BUILTIN)
+};
+#undef REGISTER_BUILTIN
+
+#define BUILTINS_NUM ((int)(sizeof(builtins) / sizeof(builtins[0])))
+
+//slot -> index into builtins + 1, 0 marks an empty slot
+static unsigned char builtin_index[BUILTIN_INDEX_SIZE];
+
+/*
+ * length, first and last character only, chosen so the registered names do
+ * not collide. probing still keeps lookups correct if a new name does.
+ */
+static unsigned builtinHash(const char* name, size_t len) {
+    return (len + (unsigned char)name[0] * 10 + (unsigned char)name[len - 1]) & (BUILTIN_INDEX_SIZE - 1);
+}
+
+void initBuiltins(void) {
+    for (int i = 0; i < BUILTINS_NUM; i++) {
+        unsigned slot = builtinHash(builtins[i].name, strlen(builtins[i].name));
+        while (builtin_index[slot]) {
+            slot = (slot + 1) & (BUILTIN_INDEX_SIZE - 1);
+        }
+        builtin_index[slot] = i + 1;
+    }
+}
+
+const Builtin* findBuiltin(const char* cmd) {
+    size_t len = strlen(cmd);
+    if (len == 0) {
+        return NULL;
+    }
+    unsigned slot = builtinHash(cmd, len);
+    while (builtin_index[slot]) {
+        const Builtin* builtin = &builtins[builtin_index[slot] - 1];
+        if (strcmp(builtin->name, cmd) == 0) {
+            return builtin;
+        }
+        slot = (slot + 1) & (BUILTIN_INDEX_SIZE - 1);
+    }
+    return NULL;
+}
@@ -0,0 +1,83 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include "commands.h"
+
+/*=============================================================================
+* builtin registry
+*
+* every builtin is registered once, in BUILTIN_LIST below. the flags tell the
+* executor how a backgrounded run has to be carried out:
+*   BUILTIN_NEEDS_FORK  - runs in a forked child so it cannot touch the shell
+*   BUILTIN_THREAD_SAFE - touches no shell state and may run off the main
+*                         thread, without NEEDS_FORK it simply runs in-process,
+*                         with it it goes to the thread pool (threadpool.h)
+*                         and only falls back to a fork if that fails
+*   BUILTIN_PATH_ARGS   - its arguments are file names. a pool thread has no
+*                         cwd of its own, so they are made absolute when the
+*                         command is submitted, as a forked child would see
+*                         them. thread safe builtins that take relative
+*                         paths need it
+=============================================================================*/
+typedef enum {
+    BUILTIN_NEEDS_FORK  = 1 << 0,
+    BUILTIN_THREAD_SAFE = 1 << 1,
+    BUILTIN_PATH_ARGS   = 1 << 2,
+} BuiltinFlags;
+
+#define BUILTIN_LIST(X) \
+    X(showpid, cmd_showpid, BUILTIN_THREAD_SAFE) \
+    X(pwd,     cmd_pwd,     BUILTIN_THREAD_SAFE) \
+    X(cd,      cmd_cd,      BUILTIN_NEEDS_FORK) \
+    X(jobs,    cmd_jobs,    BUILTIN_NEEDS_FORK) \
+    X(kill,    cmd_kill,    BUILTIN_NEEDS_FORK) \
+    X(fg,      cmd_fg,      BUILTIN_NEEDS_FORK) \
+    X(bg,      cmd_bg,      BUILTIN_NEEDS_FORK) \
+    X(quit,    cmd_quit,    BUILTIN_NEEDS_FORK) \
+    X(diff,    cmd_diff,    BUILTIN_NEEDS_FORK | BUILTIN_THREAD_SAFE | BUILTIN_PATH_ARGS) \
+    X(alias,   cmd_alias,   BUILTIN_NEEDS_FORK) \
+    X(unalias, cmd_unalias, BUILTIN_NEEDS_FORK) \
+    X(hash,    cmd_hash,    BUILTIN_NEEDS_FORK) \
+    X(spawnmode, cmd_spawnmode, BUILTIN_NEEDS_FORK) \
+    X(parallel, cmd_parallel, BUILTIN_NEEDS_FORK) \
+    X(bench,   cmd_bench,   BUILTIN_NEEDS_FORK) \
+    X(lastjobs, cmd_lastjobs, BUILTIN_NEEDS_FORK) \
+    X(stats,   cmd_stats,   BUILTIN_NEEDS_FORK) \
+    X(history, cmd_history, BUILTIN_NEEDS_FORK) \
+    X(sched,   cmd_sched,   BUILTIN_NEEDS_FORK) \
+    X(renice,  cmd_renice,  BUILTIN_NEEDS_FORK) \
+    X(pin,     cmd_pin,     BUILTIN_NEEDS_FORK) \
+    X(placement, cmd_placement, BUILTIN_NEEDS_FORK) \
+    X(submit,  cmd_submit,  BUILTIN_NEEDS_FORK)
+
+typedef CommandResult (*BuiltinHandler)(int argc, char* argv[]);
+
+typedef struct {
+    const char* name;
+    BuiltinHandler handler;
+    unsigned flags;
+} Builtin;
+
+#define DECLARE_BUILTIN(name, handler, flags) \
+    CommandResult handler(int argc, char* argv[]);
+BUILTIN_LIST(DECLARE_BUILTIN)
+#undef DECLARE_BUILTIN
+
+/*=============================================================================
+* global functions
+=============================================================================*/
+
+/*
+ * fills the lookup index from BUILTIN_LIST, once at startup before any
+ * findBuiltin
+ */
+void initBuiltins(void);
+
+/*
+ * returns the registry entry for cmd, or NULL if it is not a builtin
+ */
+const Builtin* findBuiltin(const char* cmd);
+
+#endif //BUILTINS_H
@@ -1,22 +1,43 @@
 //commands.c
+#define _GNU_SOURCE
 #include "commands.h"
+#include "builtins.h"
+#include "filecmp.h"
+#include "history.h"
+#include "linereader.h"
+#include "pathcache.h"
+#include "affinity.h"
+#include "plancache.h"
+#include "schedpolicy.h"
+#include "spawn.h"
+#include "threadpool.h"
+#include "signals.h"
 #include "signal.h"
 
 #include <ctype.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <pthread.h>
 #include <errno.h>
+#include <limits.h>
 
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
 
-Job* jobs_list = NULL;
 pid_t foreground_pid = -1;
-char foreground_cmd[CMD_LENGTH_MAX] = {0};
-char pwd[CMD_LENGTH_MAX] = "first";
+const char* foreground_cmd = NULL;
+Arena line_arena = {0};
+char pwd[PATH_MAX] = "first";
 
-Alias* alias_list = NULL;
+//how long quit kill lets jobs react to SIGTERM before sending SIGKILL
+#define QUIT_GRACE_SECS 5
+
+//resources used by the processes reaped by the last waitForeground()
+static struct rusage foreground_usage;
 
 //example function for printing errors from internal commands
 void perrorSmash(const char* cmd, const char* msg)
@@ -27,196 +48,132 @@ void perrorSmash(const char* cmd, const char* msg)
 		msg);
 }
 
-void cleanFinishedJobs(void) {
-
-	Job* curr = jobs_list;
-	Job* prev = NULL;
-
-	while (curr != NULL) {
-		int status;
-		pid_t pid = my_system_call(SYS_WAITPID, curr->pid, &status, WNOHANG);
-		if(pid == -1) {
-			//waitpid failed
-			perrorSmash("waitpid", "waitpid failed");
-
-			prev = curr;
-			curr = curr->next;
-			continue;
+//thread jobs end the way their builtin did, with what their worker used
+static void reapThreadJobs(void) {
+	Job* next;
+	for(Job* job = firstJob(); job != NULL; job = next) {
+		next = nextJob(job);
+		if(job->task && isTaskDone(job->task)) {
+			job->status = W_EXITCODE(job->task->result == SMASH_FAIL ? 1 : 0, 0);
+			job->usage = job->task->usage;
+			freeTask(job->task);
+			job->task = NULL;
+			finishJob(job);
 		}
-		if(pid == 0) {
-			//job not finished
-			prev = curr;
-			curr = curr->next;
-			continue;
-		}
-
-		//the job is done, remove
-		Job* freeJob = curr;
-		if(prev == NULL) {
-			//it's the top of the list
-			jobs_list = curr->next;
-		}else {
-			prev->next = curr->next;
-		}
-		curr = curr->next;
-		free(freeJob);
 	}
 }
 
-void printJobs(void) {
-	for(Job* job = jobs_list; job != NULL; job = job->next) {
-		time_t now = time(NULL);
-		int seconds = (int)difftime(now, job->start_time);
-
-		printf("[%d] %s: %d %d secs", job->job_id, job->command, job->pid, seconds);
+static void startQueuedJobs(void);
+static CommandResult runSubmitted(char* line, bool background);
 
-		if(job->state == STOPPED) {
-			printf(" (STOPPED)");
-		}
-		printf("\n");
+//what the wait status of pid means for the job it belongs to, if any
+static void jobProcessChanged(pid_t pid, int status, const struct rusage* usage) {
+	Job* job = findJobByPid(pid);
+	if(job == NULL) {
+		//not a job of ours (e.g. a foreground child), nothing to update
+		return;
 	}
-}
-
-Job* findJobById(int job_id) {
 
-	for(Job* curr = jobs_list; curr != NULL; curr = curr->next) {
-		if(curr->job_id == job_id) {
-			return curr;
-		}
+	if(WIFSTOPPED(status)) {
+		setJobState(job, STOPPED);
+	} else if(WIFCONTINUED(status)) {
+		setJobState(job, BACKGROUND);
+	} else if(jobProcessExited(job, pid, status, usage)) {
+		//the whole job is done, keep its accounting for lastjobs
+		finishJob(job);
 	}
-	return NULL;
 }
 
-int nextJobId(void) {
-
-	if(jobs_list == NULL) {
-		return 0;
+static void reapChildren(void) {
+	int status;
+	struct rusage usage;
+	pid_t pid;
+	while((pid = TIMED_SYSCALL(SYS_WAITPID, wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage))) > 0) {
+		jobProcessChanged(pid, status, &usage);
 	}
-	int id = 0;
-	for(Job* curr = jobs_list; curr != NULL; curr = curr->next) {
-		if(curr->job_id != id) {
-			return id;
-		}
-		id++;
+	if(pid == -1 && errno != ECHILD) {
+		perrorSmash("waitpid", "waitpid failed");
 	}
-	return id;
 }
 
-int addJob(pid_t pid, const char* command, JobState state) {
-
-	Job* newJob = MALLOC_VALIDATED(Job, sizeof(Job));
-	newJob->job_id = nextJobId();
-	newJob->pid = pid;
-	strncpy(newJob->command, command, CMD_LENGTH_MAX - 1);
-	newJob->command[CMD_LENGTH_MAX - 1] = '\0';
-	newJob->start_time = time(NULL);
-	newJob->state = state;
-	newJob->next = NULL;
+void cleanFinishedJobs(void) {
 
-	//find its spot in the job list
-	if(jobs_list == NULL) {
-		jobs_list = newJob;
-		return newJob->job_id;
-	}
-	if(newJob->job_id == 0) {
-		newJob->next = jobs_list;
-		jobs_list = newJob;
-		return newJob->job_id;
+	if(consumeFinishedTasks()) {
+		reapThreadJobs();
 	}
 
-	Job* temp = jobs_list;
-	for(int i = 0; i < newJob->job_id-1; i++) {
-		temp = temp->next;
+	//nothing changed since the last reap, so no syscalls at all
+	if(consume_sigchld()) {
+		reapChildren();
 	}
 
-	newJob->next = temp->next;
-	temp->next = newJob;
-
-	return newJob->job_id;
+	//the slots freed by whatever was reaped go to the queue
+	startQueuedJobs();
 }
-void removeJobById(int job_id) {
 
-	Job* curr = jobs_list, *prev = NULL;
+static void printUsage(const struct rusage* usage) {
+	printf("user %ld.%03lds sys %ld.%03lds maxrss %ldKB csw %ld/%ld",
+		(long)usage->ru_utime.tv_sec, (long)usage->ru_utime.tv_usec / 1000,
+		(long)usage->ru_stime.tv_sec, (long)usage->ru_stime.tv_usec / 1000,
+		usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw);
+}
 
-	while(curr != NULL) {
-		if(curr->job_id == job_id) {
-			if(prev == NULL) {
-				jobs_list = curr->next;
-			}else {
-				prev->next = curr->next;
-			}
-			free(curr);
+//the mask the first live process of job has right now
+static void printJobCpus(const Job* job) {
+	CpuSet cpus;
+	for(int i = 0; i < job->pids_num; i++) {
+		if(job->pids[i] && getProcessCpus(job->pids[i], &cpus)) {
+			printf(" | cpus ");
+			printCpuList(&cpus);
 			return;
 		}
-		prev = curr;
-		curr = curr->next;
 	}
 }
 
-Job* findMaxIdJobForFG(void) {
-	Job* max = NULL;
-	for(Job* curr = jobs_list; curr != NULL; curr = curr->next) {
-		if(!max || curr->job_id > max->job_id) {
-			max = curr;
-		}
-	}
-	return max;
-}
+//verbose adds what the processes of the job reaped so far have used and their cpus
+void printJobs(bool verbose) {
+	for(Job* job = firstJob(); job != NULL; job = nextJob(job)) {
+		time_t now = time(NULL);
+		int seconds = (int)difftime(now, job->start_time);
 
-Job* findMaxIdJobForBG(void) {
-	Job* max = NULL;
-	for(Job* curr = jobs_list; curr != NULL; curr = curr->next) {
-		if((!max || curr->job_id > max->job_id) && curr->state == STOPPED) {
-			max = curr;
+		printf("[%d] %s: %d %d secs", job->job_id, job->command, job->pid, seconds);
+
+		if(job->state == STOPPED) {
+			printf(" (STOPPED)");
+		}
+		if(job->task) {
+			printf(" (THREAD)");
+		}
+		if(job->state == QUEUED) {
+			printf(" (QUEUED)");
+		}
+		if(verbose && job->task) {
+			printf(" | running on a pool thread");
+		} else if(verbose && job->state == QUEUED) {
+			printf(" | priority %d", job->priority);
+		} else if(verbose) {
+			printf(" | %d/%d running | ", job->alive, job->pids_num);
+			printUsage(&job->usage);
+			printJobCpus(job);
 		}
+		printf("\n");
 	}
-	return max;
 }
 
+void printFinishedJobs(void) {
+	for(int i = 0; i < finishedJobsCount(); i++) {
+		const FinishedJob* job = finishedJob(i);
+		int seconds = (int)difftime(job->end_time, job->start_time);
 
-
-//example function for parsing commands
-ParsingError parseCmdExample(char* line, char* argv[ARGS_NUM_MAX+1], int* argc, bool* isBackground)
-{
-	char* delimiters = " \t\n"; //parsing should be done by spaces, tabs or newlines
-	char* cmd = strtok(line, delimiters); //read strtok documentation - parses string by delimiters
-	if(!cmd)
-		return INVALID_COMMAND; //this means no tokens were found, most like since command is invalid
-
-	*argc = 1;
-	*isBackground = false;
-	argv[0] = cmd; //first token before spaces/tabs/newlines should be command name
-	for(int i = 1; i < ARGS_NUM_MAX; i++)
-	{
-		argv[i] = strtok(NULL, delimiters); //first arg NULL -> keep tokenizing from previous call
-		if(!argv[i])
-			break;
-		(*argc)++;
-	}
-
-	if(strcmp(argv[(*argc)-1], "&") == 0) {
-		*isBackground = true;
-		(*argc)--;
+		printf("[%d] %s: %d %d secs | ", job->job_id, job->command, job->pid, seconds);
+		if(WIFSIGNALED(job->status)) {
+			printf("signal %d | ", WTERMSIG(job->status));
+		} else {
+			printf("exit %d | ", WEXITSTATUS(job->status));
+		}
+		printUsage(&job->usage);
+		printf("\n");
 	}
-
-	argv[*argc] = NULL;
-	return VALID_COMMAND;
-}
-
-bool isBuiltin(const char* cmd) {
-	return
-		strcmp(cmd, "showpid")      == 0 ||
-		strcmp(cmd, "pwd")     == 0 ||
-		strcmp(cmd, "cd") == 0 ||
-		strcmp(cmd, "jobs")    == 0 ||
-		strcmp(cmd, "kill")      == 0 ||
-		strcmp(cmd, "fg")      == 0 ||
-		strcmp(cmd, "bg")    == 0 ||
-		strcmp(cmd, "quit")    == 0 ||
-		strcmp(cmd, "diff")    == 0 ||
-		strcmp(cmd, "alias")   == 0 ||
-		strcmp(cmd, "unalias") == 0;
-
 }
 
 bool isNumber(const char* num) {
@@ -245,8 +202,8 @@ CommandResult cmd_pwd(int argc, char* argv[]) {
 		return SMASH_FAIL;
 	}
 
-	char cwd[CMD_LENGTH_MAX];
-	if(!getcwd(cwd, CMD_LENGTH_MAX)) {
+	char cwd[PATH_MAX];
+	if(!getcwd(cwd, sizeof(cwd))) {
 		perrorSmash("pwd", "getcwd failed");
 		return SMASH_FAIL;
 	}
@@ -264,23 +221,21 @@ CommandResult cmd_cd(int argc, char* argv[]) {
 			perrorSmash("cd", "old pwd not set");
 			return SMASH_FAIL;
 		}
-		char temp[CMD_LENGTH_MAX];
+		char temp[PATH_MAX];
 		strcpy(temp, pwd);
-		getcwd(pwd, CMD_LENGTH_MAX);
+		getcwd(pwd, sizeof(pwd));
 		if(chdir(temp) != 0) {
 			perrorSmash("cd", "chdir failed");
 			return SMASH_FAIL;
 		}
 		return SMASH_SUCCESS;
 	}
-	char temp[CMD_LENGTH_MAX];
+	char temp[PATH_MAX];
 	strcpy(temp, pwd);
-	getcwd(pwd, CMD_LENGTH_MAX);
+	getcwd(pwd, sizeof(pwd));
 	if(chdir(argv[1]) != 0) {
 		if(errno == ENOTDIR) {
-			char buffer[CMD_LENGTH_MAX];
-			sprintf(buffer, "%s: not a directory", argv[1]);
-			perrorSmash("cd",buffer);
+			perrorSmash("cd", arenaPrintf(&line_arena, "%s: not a directory", argv[1]));
 		}else if(errno == ENOENT) {
 			perrorSmash("cd", "target directory does not exist");
 		}
@@ -292,38 +247,283 @@ CommandResult cmd_cd(int argc, char* argv[]) {
 
 CommandResult cmd_jobs(int argc, char* argv[]) {
 
-	if(argc != 1) {
+	bool verbose = argc == 2 && strcmp(argv[1], "-v") == 0;
+	if(argc != 1 && !verbose) {
 		perrorSmash("jobs", "expected 0 argument");
 		return SMASH_FAIL;
 	}
     cleanFinishedJobs();
-	printJobs();
+	printJobs(verbose);
 	return SMASH_SUCCESS;
 }
 
+CommandResult cmd_lastjobs(int argc, char* argv[]) {
+
+	if(argc != 1) {
+		perrorSmash("lastjobs", "expected 0 arguments");
+		return SMASH_FAIL;
+	}
+	cleanFinishedJobs();
+	printFinishedJobs();
+	return SMASH_SUCCESS;
+}
+
+//job ids first..last, a single id when last is -1
+typedef struct {
+	int first;
+	int last;
+} JobRange;
+
+//parses N, %N, N-M or %N-%M
+static bool parseJobRange(const char* arg, JobRange* range) {
+	char* copy = arenaStrdup(&line_arena, arg);
+	char* dash = strchr(copy, '-');
+	if(dash) {
+		*dash = '\0';
+	}
+
+	char* first = copy[0] == '%' ? copy + 1 : copy;
+	char* last = dash ? (dash[1] == '%' ? dash + 2 : dash + 1) : NULL;
+	if(!*first || !isNumber(first) || (last && (!*last || !isNumber(last)))) {
+		return false;
+	}
+	range->first = atoi(first);
+	range->last = last ? atoi(last) : -1;
+	return !last || range->last >= range->first;
+}
+
+/*
+ * parses every argument into a JobRange, NULL (after reporting it against
+ * cmd) unless all of them parse
+ */
+static JobRange* parseJobTargets(const char* cmd, int targets_num, char* args[]) {
+	JobRange* targets = arenaAlloc(&line_arena, targets_num * sizeof(JobRange));
+	for(int i = 0; i < targets_num; i++) {
+		if(!parseJobRange(args[i], &targets[i])) {
+			perrorSmash(cmd, "invalid arguments");
+			return NULL;
+		}
+	}
+	return targets;
+}
+
+typedef bool (*JobAction)(Job* job, const void* arg);
+
+/*
+ * runs action on every job of targets. a missing single id is an error, a
+ * range only covers the jobs that exist. returns false if anything failed
+ */
+static bool forEachJobTarget(const char* cmd, const JobRange* targets, int targets_num, JobAction action, const void* arg) {
+	bool ok = true;
+	for(int i = 0; i < targets_num; i++) {
+		if(targets[i].last == -1) {
+			Job* job = findJobById(targets[i].first);
+			if(job == NULL) {
+				perrorSmash(cmd, arenaPrintf(&line_arena, "job id %d does not exist", targets[i].first));
+				ok = false;
+			} else if(!action(job, arg)) {
+				ok = false;
+			}
+			continue;
+		}
+		for(Job* job = findJobFrom(targets[i].first); job && job->job_id <= targets[i].last; job = nextJob(job)) {
+			if(!action(job, arg)) {
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+static bool signalJob(Job* job, const void* arg) {
+	const int sigNum = *(const int*)arg;
+	if(job->task) {
+		perrorSmash("kill", arenaPrintf(&line_arena, "job id %d runs on a thread and cannot be signalled", job->job_id));
+		return false;
+	}
+	if(job->state == QUEUED) {
+		//nothing runs yet, any signal but 0 takes it out of the queue
+		if(sigNum != 0) {
+			printf("job id %d was removed from the queue\n", job->job_id);
+			job->status = sigNum & 0x7f;
+			finishJob(job);
+		}
+		return true;
+	}
+	if(my_system_call(SYS_KILL, -job->pid, sigNum) == -1) {
+		perrorSmash("kill", "kill failed");
+		return false;
+	}
+	printf("signal %d was sent to pid %d\n", sigNum, job->pid);
+	return true;
+}
+
+/*
+ * kill [-]signum target... where a target is a job id (N or %N) or a range
+ * of ids (N-M or %N-%M). the signal goes to the process group of each job.
+ * a missing single id is an error, a range only covers the jobs that exist.
+ */
 CommandResult cmd_kill(int argc, char* argv[]) {
-	if(argc != 3) {
+	if(argc < 3) {
 		perrorSmash("kill", "invalid arguments");
 		return SMASH_FAIL;
 	}
-	if(!isNumber(argv[1]) || !isNumber(argv[2])) {
+	const char* sig = argv[1][0] == '-' ? argv[1] + 1 : argv[1];
+	if(!*sig || !isNumber(sig)) {
 		perrorSmash("kill", "invalid arguments");
 		return SMASH_FAIL;
 	}
 
-	const int sigNum = atoi(argv[1]);
-	const int jobId = atoi(argv[2]);
-
-	Job* job = findJobById(jobId);
-	if(job == NULL) {
-		char buffer[CMD_LENGTH_MAX];
-		sprintf(buffer, "job id %s does not exist", argv[2]);
-		perrorSmash("kill", buffer);
+	//nothing is sent unless every target parses
+	JobRange* targets = parseJobTargets("kill", argc - 2, argv + 2);
+	if(!targets) {
 		return SMASH_FAIL;
 	}
 
-	printf("signal %d was sent to pid %d\n", sigNum, job->pid);
-	return SMASH_SUCCESS;
+	const int sigNum = atoi(sig);
+	return forEachJobTarget("kill", targets, argc - 2, signalJob, &sigNum) ? SMASH_SUCCESS : SMASH_FAIL;
+}
+
+static CommandResult statusToResult(int status) {
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        return SMASH_FAIL;
+    }
+    if (WIFSIGNALED(status)) {
+        return SMASH_FAIL;
+    }
+    return SMASH_SUCCESS;
+}
+
+//the index of pid in pids, -1 if it is not there
+static int indexOfPid(const pid_t* pids, int pids_num, pid_t pid) {
+    for (int i = 0; i < pids_num; i++) {
+        if (pids[i] == pid) return i;
+    }
+    return -1;
+}
+
+/*
+ * waits on the foreground process group pgid until every process in pids is
+ * gone, or until one of them stops, in which case what is left of the job
+ * goes back to the job list as stopped. status receives the status of the
+ * last process in pids, and foreground_usage what the reaped ones used.
+ * background children are reaped meanwhile too, so the slots they free go
+ * to queued jobs without waiting for the foreground. returns false if
+ * waiting failed.
+ */
+static bool waitForeground(pid_t pgid, pid_t* pids, int pids_num, const char* cmd_line, int* status) {
+
+    foreground_pid = pgid;
+    foreground_cmd = cmd_line;
+
+    const pid_t last = pids[pids_num - 1];
+    int alive = 0;
+    for (int i = 0; i < pids_num; i++) {
+        if (pids[i]) alive++;
+    }
+
+    bool ok = true;
+    *status = 0;
+    memset(&foreground_usage, 0, sizeof(foreground_usage));
+    while (alive > 0) {
+        int wait_status;
+        struct rusage usage;
+        pid_t wait_result = TIMED_SYSCALL(SYS_WAITPID, wait4(-1, &wait_status, WUNTRACED | WCONTINUED, &usage));
+        if (wait_result == -1) {
+            if (errno == EINTR) {
+                //CTRL+C or CTRL+Z, kill or stop the group and keep waiting
+                handle_pending_signals();
+                continue;
+            }
+            perrorSmash(cmd_line, "waitpid failed");
+            ok = false;
+            break;
+        }
+        const int index = indexOfPid(pids, pids_num, wait_result);
+        if (index == -1) {
+            jobProcessChanged(wait_result, wait_status, &usage);
+            startQueuedJobs();
+            continue;
+        }
+        if (WIFCONTINUED(wait_status)) {
+            continue;
+        }
+
+        if (WIFSTOPPED(wait_status)) {
+            *status = wait_status;
+            if (addJobGroup(pgid, pids, pids_num, cmd_line, STOPPED) == -1) {
+                perrorSmash(cmd_line, "jobs list is full");
+                ok = false;
+            }
+            break;
+        }
+
+        addUsage(&foreground_usage, &usage);
+        pids[index] = 0;
+        alive--;
+        if (wait_result == last) {
+            *status = wait_status;
+        }
+    }
+
+    foreground_pid = -1;
+    foreground_cmd = NULL;
+    return ok;
+}
+
+/*
+ * waits for a builtin on a pool thread to finish, then frees its task and
+ * returns what the builtin returned. it cannot be stopped or killed, but
+ * CTRL+C and CTRL+Z are still answered and children reaped while it runs
+ */
+static CommandResult waitThreadTask(ThreadTask* task, const char* cmd_line) {
+	foreground_cmd = cmd_line;
+
+	struct pollfd pfd = { .fd = signal_fd(), .events = POLLIN };
+	while(!isTaskDone(task)) {
+		poll(&pfd, 1, -1);
+		drain_signal_fd();
+		handle_pending_signals();
+		cleanFinishedJobs();
+	}
+
+	foreground_cmd = NULL;
+	const CommandResult res = task->result;
+	freeTask(task);
+	return res;
+}
+
+/*
+ * gives job the scheduling policy and cpus of its new role: placed cpus in
+ * the background, the shell's own in the foreground. best effort, without
+ * CAP_SYS_NICE a job started niced cannot get its priority back, which is
+ * said once
+ */
+static void setJobRole(Job* job, SchedRole role) {
+	static bool told_nice = false;
+	CpuSet placed;
+	const CpuSet* cpus = NULL;
+	if(role == SCHED_BACKGROUND && placeJob(&placed)) {
+		cpus = &placed;
+	} else if(role == SCHED_FOREGROUND && job->cpus) {
+		cpus = shellCpus();
+	}
+
+	for(int i = 0; i < job->pids_num; i++) {
+		if(job->pids[i]) {
+			if(!applySchedPolicyToProcess(job->pids[i], schedPolicy(role)) &&
+				(errno == EPERM || errno == EACCES) && !told_nice) {
+				perrorSmash(job->command, "cannot undo the background priority, the job keeps running niced");
+				told_nice = true;
+			}
+			if(cpus) {
+				pinProcess(job->pids[i], cpus);
+			}
+		}
+	}
+	if(cpus) {
+		setJobCpus(job, role == SCHED_BACKGROUND ? cpus : NULL);
+	}
 }
 
 CommandResult cmd_fg(int argc, char* argv[]) {
@@ -351,34 +551,44 @@ CommandResult cmd_fg(int argc, char* argv[]) {
 		job = findJobById(job_id);
 
 		if(job == NULL) {
-			char buffer[CMD_LENGTH_MAX];
-			sprintf(buffer, "job id %s does not exist", argv[1]);
-			perrorSmash("fg", buffer);
+			perrorSmash("fg", arenaPrintf(&line_arena, "job id %s does not exist", argv[1]));
 			return SMASH_FAIL;
 		}
 	}
 
 	printf("[%d] %s\n", job->job_id, job->command);
 
+	if(job->task) {
+		ThreadTask* task = job->task;
+		const char* command = arenaStrdup(&line_arena, job->command);
+		removeJobById(job->job_id);
+		return waitThreadTask(task, command);
+	}
+	if(job->state == QUEUED) {
+		//jumps the queue and the running limit
+		char* line = arenaStrdup(&line_arena, job->command);
+		removeJobById(job->job_id);
+		fflush(stdout);
+		return runSubmitted(line, false);
+	}
+
+	setJobRole(job, SCHED_FOREGROUND);
 	if(job->state == STOPPED) {
-		my_system_call(SYS_KILL, job->pid, SIGCONT);
+		my_system_call(SYS_KILL, -job->pid, SIGCONT);
 	}
 
-	foreground_pid = job->pid;
-	strncpy(foreground_cmd, job->command, CMD_LENGTH_MAX-1);
-	foreground_cmd[CMD_LENGTH_MAX-1] = '\0';
+	//the job leaves the list while it is in the foreground
+	const pid_t pgid = job->pid;
+	const int pids_num = job->pids_num;
+	pid_t* pids = arenaAlloc(&line_arena, pids_num * sizeof(pid_t));
+	memcpy(pids, job->pids, pids_num * sizeof(pid_t));
+	const char* command = arenaStrdup(&line_arena, job->command);
 
 	removeJobById(job->job_id);
 
 	int status;
-	if(my_system_call(SYS_WAITPID, job->pid, &status, 0) == -1) {
-		perrorSmash("fg", "waitpid failed");
-		return SMASH_FAIL;
-	}
-
-	foreground_pid = -1;
-	foreground_cmd[0] = '\0';
-	return SMASH_SUCCESS;
+	bool ok = waitForeground(pgid, pids, pids_num, command, &status);
+	return ok ? SMASH_SUCCESS : SMASH_FAIL;
 
 }
 
@@ -405,25 +615,103 @@ CommandResult cmd_bg(int argc, char* argv[]) {
 		job = findJobById(job_id);
 
 		if(job == NULL) {
-			char buffer[CMD_LENGTH_MAX];
-			sprintf(buffer, "job id %s does not exist", argv[1]);
-			perrorSmash("bg", buffer);
+			perrorSmash("bg", arenaPrintf(&line_arena, "job id %s does not exist", argv[1]));
+			return SMASH_FAIL;
+		}
+		if(job->state == QUEUED) {
+			perrorSmash("bg", arenaPrintf(&line_arena, "job id %s is queued", argv[1]));
 			return SMASH_FAIL;
 		}
 		if(job->state != STOPPED) {
-			char buffer[CMD_LENGTH_MAX];
-			sprintf(buffer, "job id %s is already in background", argv[1]);
-			perrorSmash("bg", buffer);
+			perrorSmash("bg", arenaPrintf(&line_arena, "job id %s is already in background", argv[1]));
 			return SMASH_FAIL;
 		}
 	}
 
 	printf("[%d] %s\n", job->job_id, job->command);
-	job->state = BACKGROUND;
-	my_system_call(SYS_KILL, job->pid, SIGCONT);
+	setJobState(job, BACKGROUND);
+	setJobRole(job, SCHED_BACKGROUND);
+	my_system_call(SYS_KILL, -job->pid, SIGCONT);
 	return SMASH_SUCCESS;
 }
 
+static long msUntil(const struct timespec* deadline) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+/*
+ * sends SIGTERM to every job at once, then waits for all of them against a
+ * single grace deadline, only jobs still alive when it expires get SIGKILL
+ */
+static void terminateAllJobs(void) {
+
+	Job* last = findMaxIdJobForFG();
+	if(last == NULL) {
+		return;
+	}
+	bool* exited = calloc(last->job_id + 1, sizeof(bool));
+	if(!exited) ERROR_EXIT("calloc");
+
+	//threads cannot be signalled, they end with the shell, queued jobs never start
+	int alive = 0;
+	for(Job* job = firstJob(); job != NULL; job = nextJob(job)) {
+		if(job->task || job->state == QUEUED) {
+			exited[job->job_id] = true;
+			continue;
+		}
+		my_system_call(SYS_KILL, -job->pid, SIGTERM);
+		alive++;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += QUIT_GRACE_SECS;
+
+	struct pollfd pfd = { .fd = signal_fd(), .events = POLLIN };
+	while(alive > 0) {
+		drain_signal_fd();
+		consume_sigchld();
+
+		int status;
+		struct rusage usage;
+		pid_t pid;
+		while(alive > 0 && (pid = TIMED_SYSCALL(SYS_WAITPID, wait4(-1, &status, WNOHANG, &usage))) > 0) {
+			Job* job = findJobByPid(pid);
+			if(job != NULL && jobProcessExited(job, pid, status, &usage)) {
+				exited[job->job_id] = true;
+				alive--;
+			}
+		}
+
+		long timeout = msUntil(&deadline);
+		if(alive == 0 || timeout <= 0) {
+			break;
+		}
+		poll(&pfd, 1, (int)timeout);
+	}
+
+	for(Job* job = firstJob(); job != NULL; job = nextJob(job)) {
+		if(job->task) {
+			printf("[%d] %s - runs in the shell, ends with it\n", job->job_id, job->command);
+			continue;
+		}
+		if(job->state == QUEUED) {
+			printf("[%d] %s - dropped from the queue\n", job->job_id, job->command);
+			continue;
+		}
+		printf("[%d] %s - sending SIGTERM... ", job->job_id, job->command);
+		if(!exited[job->job_id]) {
+			my_system_call(SYS_KILL, -job->pid, SIGKILL);
+			printf("sending SIGKILL... done\n");
+		}else {
+			printf("done\n");
+		}
+	}
+	free(exited);
+}
+
 CommandResult cmd_quit(int argc, char* argv[]) {
 
 	if(argc != 1 && argc != 2) {
@@ -440,35 +728,11 @@ CommandResult cmd_quit(int argc, char* argv[]) {
 		return SMASH_FAIL;
 	}
 
-	int status;
-	Job* job = jobs_list;
-	Job* to_free = NULL;
-	while(job != NULL) {
-
-		printf("[%d] %s - ", job->job_id, job->command);
-		my_system_call(SYS_KILL, job->pid, SIGTERM);
-		printf("sending SIGTERM... ");
-		fflush(stdout);
-		sleep(5);
-		if(my_system_call(SYS_WAITPID, job->pid, &status, WNOHANG) == 0) {
-			my_system_call(SYS_KILL, job->pid, SIGKILL);
-			printf("sending SIGKILL... done\n");
-		}else {
-			printf("done\n");
-		}
+	terminateAllJobs();
+	clearJobs();
 
-		to_free = job;
-		job = job->next;
-		free(to_free);
-	}
-
-	Alias* curr = alias_list;
-	Alias* alias_to_free = NULL;
-	while(curr != NULL) {
-		alias_to_free = curr;
-		curr = curr->next;
-		free(alias_to_free);
-	}
+	clearAliases();
+	clearPlanCache();
 
 	return SMASH_QUIT;
 }
@@ -486,37 +750,6 @@ static bool isFile(char* path) {
 	return S_ISREG(st.st_mode);
 }
 
-static bool areFilesEqual(char* path1, char* path2) {
-
-	FILE *f1 = fopen(path1, "rb");
-	FILE *f2 = fopen(path2, "rb");
-
-	if(f1 == NULL || f2 == NULL) {
-		if(f1) {
-			fclose(f1);
-		}
-		if(f2) {
-			fclose(f2);
-		}
-		return false;
-	}
-
-	int c1, c2;
-	do {
-		c1 = fgetc(f1);
-		c2 = fgetc(f2);
-		if(c1 != c2) {
-			fclose(f1);
-			fclose(f2);
-			return false;
-		}
-	}while (c1 != EOF && c2 != EOF);
-
-	fclose(f1);
-	fclose(f2);
-	return true;
-}
-
 CommandResult cmd_diff(int argc, char* argv[]) {
 
 	if(argc != 3) {
@@ -542,57 +775,9 @@ CommandResult cmd_diff(int argc, char* argv[]) {
 }
 
 
-Alias* findAlias(char* name) {
-    Alias* curr = alias_list;
-    while(curr) {
-        // return current if found
-        if(strcmp(curr->alias, name) == 0) return curr;
-        curr = curr->next;
-    }
-    //didnt find the alias in the linked list
-    return NULL;
-}
-
-void addAlias(char* name, char* command) {
-    //checks for alias
-    Alias* found = findAlias(name);
-    if(found) {
-
-        //found so puts the command in the alias
-        strcpy(found->command, command);
-    } else {
-        //didnt find the alias so created a new ALIAS
-        Alias* new_alias = MALLOC_VALIDATED(Alias, sizeof(Alias));
-        strcpy(new_alias->alias, name);
-        strcpy(new_alias->command, command);
-        new_alias->next = alias_list;
-        alias_list = new_alias;
-    }
-}
-
-void removeAlias(char* name) {
-    Alias* curr = alias_list;
-    Alias* prev = NULL;
-    while(curr) {
-        if(strcmp(curr->alias, name) == 0) {
-            if(prev == NULL) alias_list = curr->next;
-            else prev->next = curr->next;
-            free(curr);
-            return;
-        }
-        prev = curr;
-        curr = curr->next;
-    }
-
-    //looped through the entire thing and didnt find the alias
-    char error_msg[CMD_LENGTH_MAX];
-    sprintf(error_msg, "alias %s does not exist", name);
-    perrorSmash("unalias", error_msg);
-}
-
 CommandResult cmd_alias(int argc, char* argv[]) {
     if (argc == 1) {
-        Alias* curr = alias_list;
+        Alias* curr = firstAlias();
         while(curr) {
             printf("%s='%s'\n", curr->alias, curr->command);
             curr = curr->next;
@@ -600,11 +785,19 @@ CommandResult cmd_alias(int argc, char* argv[]) {
         return SMASH_SUCCESS;
     }
 
-    char cmd_line[CMD_LENGTH_MAX] = {0};
+    size_t len = 0;
+    for (int i = 1; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char* cmd_line = arenaAlloc(&line_arena, len);
+    char* end = cmd_line;
     for (int i = 1; i < argc; i++) {
-        if (i > 1) strcat(cmd_line, " ");
-        strcat(cmd_line, argv[i]);
+        if (i > 1) *end++ = ' ';
+        size_t arg_len = strlen(argv[i]);
+        memcpy(end, argv[i], arg_len);
+        end += arg_len;
     }
+    *end = '\0';
 
     char* sep = strchr(cmd_line, '=');
     if (!sep) {
@@ -628,7 +821,7 @@ CommandResult cmd_alias(int argc, char* argv[]) {
         }
     }
 
-    if (isBuiltin(name)) {
+    if (findBuiltin(name)) {
         perrorSmash("alias", "alias name already exists");
         return SMASH_FAIL;
     }
@@ -642,179 +835,894 @@ CommandResult cmd_unalias(int argc, char* argv[]) {
         perrorSmash("unalias", "expected 1 argument");
         return SMASH_FAIL;
     }
-    removeAlias(argv[1]);
+    if (!removeAlias(argv[1])) {
+        perrorSmash("unalias", arenaPrintf(&line_arena, "alias %s does not exist", argv[1]));
+    }
     return SMASH_SUCCESS;
 }
 
-CommandResult runBuiltin(int argc, char* argv[])
-{
-	const char* cmd = argv[0];
+CommandResult cmd_hash(int argc, char* argv[]) {
 
-	if (strcmp(cmd, "showpid") == 0) return cmd_showpid(argc, argv);
-	if (strcmp(cmd, "pwd") == 0) return cmd_pwd(argc, argv);
-	if (strcmp(cmd, "cd") == 0) return cmd_cd(argc, argv);
-	if (strcmp(cmd, "jobs") == 0) return cmd_jobs(argc, argv);
-	if (strcmp(cmd, "kill") == 0) return cmd_kill(argc, argv);
-	if (strcmp(cmd, "fg") == 0) return cmd_fg(argc, argv);
-	if (strcmp(cmd, "bg") == 0) return cmd_bg(argc, argv);
-	if (strcmp(cmd, "quit") == 0) return cmd_quit(argc, argv);
-	if (strcmp(cmd, "diff") == 0) return cmd_diff(argc, argv);
-	if (strcmp(cmd, "alias") == 0) return cmd_alias(argc, argv);
-	if (strcmp(cmd, "unalias") == 0) return cmd_unalias(argc, argv);
+	if(argc == 1) {
+		printPathCache();
+		return SMASH_SUCCESS;
+	}
+	if(argc == 2 && strcmp(argv[1], "-r") == 0) {
+		clearPathCache();
+		return SMASH_SUCCESS;
+	}
 
-	return SMASH_FAIL;
+	CommandResult res = SMASH_SUCCESS;
+	for(int i = 1; i < argc; i++) {
+		if(!hashCommand(argv[i])) {
+			perrorSmash("hash", arenaPrintf(&line_arena, "%s: not found", argv[i]));
+			res = SMASH_FAIL;
+		}
+	}
+	return res;
 }
-CommandResult executeSingleCommand(char* cmd) {
 
-    char original_cmd[CMD_LENGTH_MAX];
-    strcpy(original_cmd, cmd);
+CommandResult cmd_stats(int argc, char* argv[]) {
+
+	if(argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)) {
+		setSyscallStats(argv[1][1] == 'n');
+		return SMASH_SUCCESS;
+	}
+	if(argc != 1) {
+		perrorSmash("stats", "expected on, off or no arguments");
+		return SMASH_FAIL;
+	}
 
-    char* argv[ARGS_NUM_MAX + 1];
-    int argc = 0;
-    bool isBackground = false;
+	if(!syscall_stats_enabled) {
+		printf("syscall stats are off, turn them on with stats on\n");
+	}
+	//dumping also starts a new measurement
+	printSyscallStats();
+	resetSyscallStats();
+	return SMASH_SUCCESS;
+}
 
-    ParsingError error = parseCmdExample(cmd, argv, &argc, &isBackground);
+//history [text] lists the remembered lines, or those that contain text
+CommandResult cmd_history(int argc, char* argv[]) {
 
-    if(error != VALID_COMMAND) {
-        perrorSmash(original_cmd, "parsing error");
+	if(argc > 2) {
+		perrorSmash("history", "expected 0 or 1 arguments");
+		return SMASH_FAIL;
+	}
+	printHistory(argc == 2 ? argv[1] : NULL);
+	return SMASH_SUCCESS;
+}
+
+//parses [-n nice] [-c class] [-i ioclass[:level]] from argv[*i] on, leaving *i past them
+static bool parsePolicyOptions(int argc, char* argv[], int* i, SchedPolicy* policy) {
+	while(*i + 1 < argc && argv[*i][0] == '-' && argv[*i][1] && !argv[*i][2]) {
+		const char* value = argv[*i + 1];
+		switch(argv[*i][1]) {
+			case 'n': {
+				char* end;
+				long nice = strtol(value, &end, 10);
+				if(!*value || *end || nice < -20 || nice > 19) {
+					return false;
+				}
+				policy->nice = (int)nice;
+				break;
+			}
+			case 'c':
+				if(!parseSchedClass(value, &policy->sched)) {
+					return false;
+				}
+				break;
+			case 'i':
+				if(!parseIoClass(value, &policy->io_class, &policy->io_level)) {
+					return false;
+				}
+				break;
+			default:
+				return false;
+		}
+		*i += 2;
+	}
+	return true;
+}
+
+/*
+ * sched prints the policies of foreground and background jobs, and
+ * sched fg|bg [-n nice] [-c normal|batch|idle] [-i none|rt|be|idle[:level]]
+ * changes one of them for the jobs started or moved from now on
+ */
+CommandResult cmd_sched(int argc, char* argv[]) {
+
+	if(argc == 1) {
+		printf("foreground: ");
+		printSchedPolicy(schedPolicy(SCHED_FOREGROUND));
+		printf("\nbackground: ");
+		printSchedPolicy(schedPolicy(SCHED_BACKGROUND));
+		printf("\n");
+		return SMASH_SUCCESS;
+	}
+
+	SchedRole role;
+	if(strcmp(argv[1], "fg") == 0) {
+		role = SCHED_FOREGROUND;
+	} else if(strcmp(argv[1], "bg") == 0) {
+		role = SCHED_BACKGROUND;
+	} else {
+		perrorSmash("sched", "invalid arguments");
+		return SMASH_FAIL;
+	}
+
+	SchedPolicy policy = *schedPolicy(role);
+	int i = 2;
+	if(!parsePolicyOptions(argc, argv, &i, &policy) || i != argc) {
+		perrorSmash("sched", "invalid arguments");
+		return SMASH_FAIL;
+	}
+	*schedPolicy(role) = policy;
+	return SMASH_SUCCESS;
+}
+
+static bool reniceJob(Job* job, const void* arg) {
+	const SchedPolicy* policy = arg;
+	if(job->task) {
+		perrorSmash("renice", arenaPrintf(&line_arena, "job id %d runs on a thread of smash", job->job_id));
+		return false;
+	}
+	bool ok = true;
+	for(int i = 0; i < job->pids_num; i++) {
+		if(job->pids[i] && !applySchedPolicyToProcess(job->pids[i], policy)) {
+			perrorSmash("renice", arenaPrintf(&line_arena, "job id %d: %s", job->job_id, strerror(errno)));
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/*
+ * renice [-n nice] [-c class] [-i ioclass[:level]] target... changes what is
+ * given for every thread of the jobs, targets as for kill. moving a job with
+ * bg or fg later applies the whole policy of its new role
+ */
+CommandResult cmd_renice(int argc, char* argv[]) {
+
+	SchedPolicy policy = SCHED_POLICY_KEEP;
+	int i = 1;
+	if(!parsePolicyOptions(argc, argv, &i, &policy) || i == argc ||
+		(policy.nice == SCHED_KEEP && policy.sched == SCHED_KEEP && policy.io_class == SCHED_KEEP)) {
+		perrorSmash("renice", "invalid arguments");
+		return SMASH_FAIL;
+	}
+
+	JobRange* targets = parseJobTargets("renice", argc - i, argv + i);
+	if(!targets) {
+		return SMASH_FAIL;
+	}
+	return forEachJobTarget("renice", targets, argc - i, reniceJob, &policy) ? SMASH_SUCCESS : SMASH_FAIL;
+}
+
+static bool pinJob(Job* job, const void* arg) {
+	const CpuSet* cpus = arg;
+	if(job->task) {
+		perrorSmash("pin", arenaPrintf(&line_arena, "job id %d runs on a thread of smash", job->job_id));
+		return false;
+	}
+	bool ok = true;
+	for(int i = 0; i < job->pids_num; i++) {
+		if(job->pids[i] && !pinProcess(job->pids[i], cpus)) {
+			perrorSmash("pin", arenaPrintf(&line_arena, "job id %d: %s", job->job_id, strerror(errno)));
+			ok = false;
+		}
+	}
+	if(ok) {
+		setJobCpus(job, cpus);
+	}
+	return ok;
+}
+
+/*
+ * pin target... cpus pins every thread of the jobs to cpus (like 0-3,8),
+ * targets as for kill
+ */
+CommandResult cmd_pin(int argc, char* argv[]) {
+
+	CpuSet cpus;
+	if(argc < 3 || !parseCpuList(argv[argc - 1], &cpus) || CPU_COUNT(&cpus.set) == 0) {
+		perrorSmash("pin", "invalid arguments");
+		return SMASH_FAIL;
+	}
+	JobRange* targets = parseJobTargets("pin", argc - 2, argv + 1);
+	if(!targets) {
+		return SMASH_FAIL;
+	}
+	return forEachJobTarget("pin", targets, argc - 2, pinJob, &cpus) ? SMASH_SUCCESS : SMASH_FAIL;
+}
+
+/*
+ * placement prints how background jobs are placed on cpus, and
+ * placement off|rr|least [-w width] [-r reserved cpus] changes it
+ */
+CommandResult cmd_placement(int argc, char* argv[]) {
+
+	if(argc == 1) {
+		printPlacement();
+		return SMASH_SUCCESS;
+	}
+
+	PlacementMode mode;
+	int width = PLACEMENT_WIDTH_DEFAULT;
+	CpuSet reserved;
+	CPU_ZERO(&reserved.set);
+	bool valid = parsePlacementMode(argv[1], &mode) && argc % 2 == 0;
+	for(int i = 2; valid && i < argc; i += 2) {
+		if(strcmp(argv[i], "-w") == 0 && *argv[i + 1] && isNumber(argv[i + 1]) && atoi(argv[i + 1]) > 0) {
+			width = atoi(argv[i + 1]);
+		} else if(strcmp(argv[i], "-r") != 0 || !parseCpuList(argv[i + 1], &reserved)) {
+			valid = false;
+		}
+	}
+	if(!valid) {
+		perrorSmash("placement", "invalid arguments");
+		return SMASH_FAIL;
+	}
+	if(!setPlacement(mode, width, &reserved)) {
+		perrorSmash("placement", "no cpu is left for background jobs");
+		return SMASH_FAIL;
+	}
+	return SMASH_SUCCESS;
+}
+
+CommandResult cmd_spawnmode(int argc, char* argv[]) {
+
+	if(argc == 1) {
+		printf("%s\n", spawnModeName(getSpawnMode()));
+		return SMASH_SUCCESS;
+	}
+
+	SpawnMode mode;
+	if(argc != 2 || !parseSpawnMode(argv[1], &mode)) {
+		perrorSmash("spawnmode", "expected fork, posix_spawn or vfork");
+		return SMASH_FAIL;
+	}
+	setSpawnMode(mode);
+	return SMASH_SUCCESS;
+}
+
+//runs one stage of a pipeline, builtins get a forked copy of the shell
+static pid_t spawnStage(int argc, char* argv[], const char* cmd_line, const SpawnOptions* options, int unused_fd) {
+
+    const Builtin* builtin = findBuiltin(argv[0]);
+    if (!builtin) {
+        //resolved in the parent so the cache outlives the child
+        return spawnCommand(lookupCommandPath(argv[0]), argv, cmd_line, options);
+    }
+
+    const pid_t pid = forkShell(cmd_line, options);
+    if (pid == 0) {
+        if (unused_fd != -1) {
+            my_system_call(SYS_CLOSE, unused_fd);
+        }
+        exit(builtin->handler(argc, argv));
+    }
+    return pid;
+}
+
+//template with every {} replaced by arg, arg goes last if there is no {}
+static char** parallelArgv(int argc, char* argv[], const char* arg) {
+
+    const size_t arg_len = strlen(arg);
+    bool placed = false;
+    char** out = arenaAlloc(&line_arena, (argc + 2) * sizeof(char*));
+    for (int i = 0; i < argc; i++) {
+        int holes = 0;
+        for (const char* p = strstr(argv[i], "{}"); p; p = strstr(p + 2, "{}")) {
+            holes++;
+        }
+        if (holes == 0) {
+            out[i] = argv[i];
+            continue;
+        }
+
+        char* word = arenaAlloc(&line_arena, strlen(argv[i]) + holes * arg_len + 1);
+        char* w = word;
+        const char* from = argv[i];
+        for (const char* p = strstr(from, "{}"); p; p = strstr(from, "{}")) {
+            memcpy(w, from, p - from);
+            w += p - from;
+            memcpy(w, arg, arg_len);
+            w += arg_len;
+            from = p + 2;
+        }
+        strcpy(w, from);
+        out[i] = word;
+        placed = true;
+    }
+    out[argc] = placed ? NULL : (char*)arg;
+    out[argc + 1] = NULL;
+    return out;
+}
+
+/*
+ * reaps one worker of group pgid, blocking if asked to. stopped workers are
+ * continued, the loop of a foreground parallel cannot be suspended anyway.
+ * returns false if there was nothing to reap
+ */
+static bool reapWorker(pid_t pgid, bool block, int* failures, bool* interrupted) {
+    while (1) {
+        int status;
+        pid_t pid = my_system_call(SYS_WAITPID, -pgid, &status, (block ? 0 : WNOHANG) | WUNTRACED);
+        if (pid == -1 && errno == EINTR) {
+            handle_pending_signals();
+            continue;
+        }
+        if (pid <= 0) {
+            return false;
+        }
+        if (WIFSTOPPED(status)) {
+            my_system_call(SYS_KILL, -pgid, SIGCONT);
+            continue;
+        }
+        if (statusToResult(status) == SMASH_FAIL) {
+            (*failures)++;
+        }
+        if (WIFSIGNALED(status) && (WTERMSIG(status) == SIGKILL || WTERMSIG(status) == SIGINT)) {
+            *interrupted = true;
+        }
+        return true;
+    }
+}
+
+/*
+ * parallel [-j N] cmd [args...] runs cmd once per line of stdin with {}
+ * replaced by the line, at most N at a time. a worker is started as soon as
+ * another one is reaped. workers share a process group, so CTRL+C reaches
+ * all of them, and never enter the job list.
+ */
+CommandResult cmd_parallel(int argc, char* argv[]) {
+
+    long max_running = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        if (!isNumber(argv[2]) || atoi(argv[2]) <= 0) {
+            perrorSmash("parallel", "invalid arguments");
+            return SMASH_FAIL;
+        }
+        max_running = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc) {
+        perrorSmash("parallel", "expected a command");
         return SMASH_FAIL;
     }
+    if (max_running <= 0) {
+        max_running = 1;
+    }
+
+    //stdin is our input, the workers must not read from it
+    int null_fd = my_system_call(SYS_OPEN, "/dev/null", O_RDONLY | O_CLOEXEC, 0);
+
+    const char* saved_cmd = foreground_cmd;
+    pid_t saved_pid = foreground_pid;
+    foreground_cmd = "parallel";
+
+    //lines already buffered for the shell are ours, a forked parallel reads its own stdin
+    LineReader own = { .fd = STDIN_FILENO, .size = INPUT_BUFFER_SIZE };
+    LineReader* reader = shellStdinReader();
+    if (!reader) {
+        own.buf = MALLOC_VALIDATED(char, own.size);
+        reader = &own;
+    }
+    const bool was_interruptible = reader->interruptible;
+    reader->interruptible = true;
+
+    pid_t pgid = 0;
+    long running = 0;
+    int failures = 0;
+    bool interrupted = false;
+    const char* text;
+    size_t len;
+
+    while (!interrupted && (text = nextLine(reader, &len)) != NULL) {
+        if (len == 0) {
+            continue;
+        }
+
+        //reap whatever is done already, then wait only if we are at the cap
+        while (running > 0 && reapWorker(pgid, running == max_running, &failures, &interrupted)) {
+            running--;
+        }
+        if (running == 0) {
+            //the group is gone with its last member
+            pgid = 0;
+            foreground_pid = saved_pid;
+        }
+        if (interrupted) {
+            break;
+        }
+
+        ArenaMark mark = arenaMark(&line_arena);
+        char* line = arenaStrndup(&line_arena, text, len);
+        char** worker_argv = parallelArgv(argc - first, argv + first, line);
+        int worker_argc = 0;
+        while (worker_argv[worker_argc]) worker_argc++;
+
+        SpawnOptions options = { .pgid = pgid, .in_fd = null_fd, .out_fd = -1,
+            .policy = spawnSchedPolicy(SCHED_FOREGROUND) };
+        pid_t pid = spawnStage(worker_argc, worker_argv, worker_argv[0], &options, -1);
+        arenaRelease(&line_arena, mark);
+        if (pid <= 0) {
+            failures++;
+            continue;
+        }
+        if (pgid == 0) {
+            pgid = pid;
+            foreground_pid = pgid;
+        }
+        running++;
+    }
+
+    //CTRL+C while blocked on stdin ends the input, the workers went with it
+    reader->interrupted = false;
+    reader->interruptible = was_interruptible;
 
-    if(argc == 0) {
+    while (running > 0 && reapWorker(pgid, true, &failures, &interrupted)) {
+        running--;
+    }
+
+    foreground_pid = saved_pid;
+    foreground_cmd = saved_cmd;
+    free(own.buf);
+    if (null_fd != -1) {
+        my_system_call(SYS_CLOSE, null_fd);
+    }
+    return failures ? SMASH_FAIL : SMASH_SUCCESS;
+}
+
+/*
+ * argv with every relative argument after the first made absolute against
+ * the cwd of now, in line_arena. NULL if the cwd cannot be had
+ */
+static char** absoluteArgv(int argc, char* argv[]) {
+    char* cwd = arenaAlloc(&line_arena, PATH_MAX);
+    if (!getcwd(cwd, PATH_MAX)) {
+        return NULL;
+    }
+    char** out = arenaAlloc(&line_arena, (argc + 1) * sizeof(char*));
+    out[0] = argv[0];
+    for (int i = 1; i < argc; i++) {
+        out[i] = argv[i][0] == '/' ? argv[i] : arenaPrintf(&line_arena, "%s/%s", cwd, argv[i]);
+    }
+    out[argc] = NULL;
+    return out;
+}
+
+//a new background job, counted against the cpus it was placed on if any
+static void addPlacedJob(pid_t pgid, const pid_t* pids, int pids_num, const char* cmd_line, const CpuSet* cpus) {
+    int job_id = addJobGroup(pgid, pids, pids_num, cmd_line, BACKGROUND);
+    if (job_id != -1 && cpus) {
+        setJobCpus(findJobById(job_id), cpus);
+    }
+}
+
+/*
+ * runs a pipeline of two or more stages. all stages share the process group
+ * of the first one, so job control acts on the pipeline as a whole.
+ */
+static CommandResult executePipeline(const Command* command) {
+
+    const int stages_num = command->stages_num;
+    const char* original_cmd = command->text;
+    pid_t* pids = arenaAlloc(&line_arena, stages_num * sizeof(pid_t));
+
+    if (command->background && isJobsListFull()) {
+        perrorSmash(original_cmd, "jobs list is full");
+        return SMASH_FAIL;
+    }
+
+    const SchedPolicy* policy = spawnSchedPolicy(command->background ? SCHED_BACKGROUND : SCHED_FOREGROUND);
+    CpuSet placed;
+    const CpuSet* cpus = command->background && placeJob(&placed) ? &placed : NULL;
+    pid_t pgid = 0;
+    int prev_read = -1;
+    for (int i = 0; i < stages_num; i++) {
+        int fds[2] = {-1, -1};
+        if (i < stages_num - 1) {
+            if (my_system_call(SYS_PIPE, fds) == -1) {
+                perrorSmash(original_cmd, "pipe failed");
+                for (int j = i; j < stages_num; j++) pids[j] = 0;
+                break;
+            }
+            //only the dup2'ed copies may survive into the stages
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        }
+
+        const Stage* stage = &command->stages[i];
+        SpawnOptions options = { .pgid = pgid, .in_fd = prev_read, .out_fd = fds[1],
+            .policy = policy, .cpus = cpus };
+        const pid_t pid = spawnStage(stage->argc, stage->argv, original_cmd, &options, fds[0]);
+        pids[i] = pid > 0 ? pid : 0;
+        if (pid > 0 && pgid == 0) {
+            pgid = pid;
+        }
+
+        if (prev_read != -1) my_system_call(SYS_CLOSE, prev_read);
+        if (fds[1] != -1) my_system_call(SYS_CLOSE, fds[1]);
+        prev_read = fds[0];
+    }
+    if (prev_read != -1) my_system_call(SYS_CLOSE, prev_read);
+
+    if (pgid == 0) {
+        return SMASH_FAIL;
+    }
+
+    if (command->background) {
+        addPlacedJob(pgid, pids, stages_num, original_cmd, cpus);
         return SMASH_SUCCESS;
     }
 
-    if(isBuiltin(argv[0])) {
-        if(isBackground) {
-            const pid_t pid = (pid_t)my_system_call(SYS_FORK);
+    bool last_spawned = pids[stages_num - 1] != 0;
+    int status;
+    if (!waitForeground(pgid, pids, stages_num, original_cmd, &status) || !last_spawned) {
+        return SMASH_FAIL;
+    }
+    return WIFSTOPPED(status) ? SMASH_SUCCESS : statusToResult(status);
+}
+
+CommandResult executeSingleCommand(const Command* command) {
+
+    if (command->stages_num > 1) {
+        return executePipeline(command);
+    }
+
+    const char* original_cmd = command->text;
+    char** argv = command->stages[0].argv;
+    const int argc = command->stages[0].argc;
+    const bool isBackground = command->background;
+
+    if(isBackground && isJobsListFull()) {
+        perrorSmash(original_cmd, "jobs list is full");
+        return SMASH_FAIL;
+    }
+
+    const Builtin* builtin = findBuiltin(argv[0]);
+    if(builtin) {
+        //no fork at all for those that may run off the main thread
+        ThreadTask* task = NULL;
+        if(isBackground && (builtin->flags & BUILTIN_NEEDS_FORK) && (builtin->flags & BUILTIN_THREAD_SAFE)) {
+            char** task_argv = (builtin->flags & BUILTIN_PATH_ARGS) ? absoluteArgv(argc, argv) : argv;
+            if(task_argv) {
+                task = submitTask(builtin->handler, argc, task_argv);
+            }
+        }
+        if(task) {
+            addThreadJob(task, original_cmd);
+            return SMASH_SUCCESS;
+        }
+        if(isBackground && (builtin->flags & BUILTIN_NEEDS_FORK)) {
+            CpuSet placed;
+            SpawnOptions options = SPAWN_OPTIONS_DEFAULT;
+            options.policy = spawnSchedPolicy(SCHED_BACKGROUND);
+            options.cpus = placeJob(&placed) ? &placed : NULL;
+            const pid_t pid = forkShell(original_cmd, &options);
             if(pid == -1) {
-                perrorSmash(original_cmd, "fork failed");
                 return SMASH_FAIL;
             }
             if(pid == 0) {
-                setpgid(0, 0);
-                exit(runBuiltin(argc, argv));
+                exit(builtin->handler(argc, argv));
             }
-            addJob(pid, original_cmd, BACKGROUND);
+            addPlacedJob(pid, &pid, 1, original_cmd, options.cpus);
             return SMASH_SUCCESS;
         }
-        return runBuiltin(argc, argv);
+        return builtin->handler(argc, argv);
     }
 
-    const pid_t pid = (pid_t)my_system_call(SYS_FORK);
+    //resolved in the parent so the cache outlives the child
+    const char* exec_path = lookupCommandPath(argv[0]);
+
+    CpuSet placed;
+    SpawnOptions options = SPAWN_OPTIONS_DEFAULT;
+    options.policy = spawnSchedPolicy(isBackground ? SCHED_BACKGROUND : SCHED_FOREGROUND);
+    options.cpus = isBackground && placeJob(&placed) ? &placed : NULL;
+    pid_t pid = spawnCommand(exec_path, argv, original_cmd, &options);
     if(pid == -1) {
-        perrorSmash(original_cmd, "fork failed");
         return SMASH_FAIL;
     }
 
-    if(pid == 0) {
-        setpgid(0, 0);
-        my_system_call(SYS_EXECVP, argv[0], argv);
-        perrorSmash(original_cmd, "execvp failed");
-        exit(EXIT_FAILURE);
-    }
-
     if(isBackground) {
-        addJob(pid, original_cmd, BACKGROUND);
+        addPlacedJob(pid, &pid, 1, original_cmd, options.cpus);
         return SMASH_SUCCESS;
     }
 
-    foreground_pid = pid;
-    strncpy(foreground_cmd, original_cmd, CMD_LENGTH_MAX - 1);
-    foreground_cmd[CMD_LENGTH_MAX - 1] = '\0';
-
     int status;
-    pid_t wait_result;
-
-    do {
-        wait_result = my_system_call(SYS_WAITPID, pid, &status, WUNTRACED);
-    } while (wait_result == -1 && errno == EINTR);
-
-    if (wait_result == -1) {
-        perrorSmash(original_cmd, "waitpid failed");
-        foreground_pid = -1;
-        foreground_cmd[0] = '\0';
+    if(!waitForeground(pid, &pid, 1, original_cmd, &status)) {
         return SMASH_FAIL;
     }
-
-    foreground_pid = -1;
-    foreground_cmd[0] = '\0';
-
     if(WIFSTOPPED(status)) {
-        addJob(pid, original_cmd, STOPPED);
         return SMASH_SUCCESS;
     }
+    return statusToResult(status);
+}
+
+
+static double timevalMs(const struct timeval* tv) {
+    return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
 
-    if (WIFEXITED(status)) {
-        if (WEXITSTATUS(status) != 0) {
+//nearest rank percentile of sorted
+static double percentile(const double* sorted, int n, int p) {
+    int rank = (p * n + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+ * runs cmd once through the executor, returns its wall time in wall_ms and
+ * the cpu time of the run, its children's and our own, in user_ms and sys_ms
+ */
+static CommandResult benchRun(const Command* command, double* wall_ms, double* user_ms, double* sys_ms) {
+
+    struct rusage self_before, self_after;
+    struct timespec start, end;
+    ArenaMark mark = arenaMark(&line_arena);
+
+    //a builtin run in-process reaps nothing
+    memset(&foreground_usage, 0, sizeof(foreground_usage));
+    getrusage(RUSAGE_SELF, &self_before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    CommandResult res = executeSingleCommand(command);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_after);
+    arenaRelease(&line_arena, mark);
+
+    struct timeval self_user, self_sys;
+    timersub(&self_after.ru_utime, &self_before.ru_utime, &self_user);
+    timersub(&self_after.ru_stime, &self_before.ru_stime, &self_sys);
+    *wall_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+    *user_ms = timevalMs(&foreground_usage.ru_utime) + timevalMs(&self_user);
+    *sys_ms = timevalMs(&foreground_usage.ru_stime) + timevalMs(&self_sys);
+    return res;
+}
+
+/*
+ * bench -n N [-w W] cmd [args...] runs cmd W times unmeasured and then N
+ * times measured, the same way a command line runs it, and prints the wall
+ * time percentiles, the mean cpu time and the throughput. stops at the first
+ * run that fails.
+ */
+CommandResult cmd_bench(int argc, char* argv[]) {
+
+    int runs = 0;
+    int warmup = 0;
+    int first = 1;
+    while (first + 1 < argc && (strcmp(argv[first], "-n") == 0 || strcmp(argv[first], "-w") == 0)) {
+        if (!isNumber(argv[first + 1]) || argv[first + 1][0] == '\0') {
+            perrorSmash("bench", "invalid arguments");
             return SMASH_FAIL;
         }
+        *(argv[first][1] == 'n' ? &runs : &warmup) = atoi(argv[first + 1]);
+        first += 2;
     }
-
-    if (WIFSIGNALED(status)) {
+    if (runs <= 0 || first >= argc) {
+        perrorSmash("bench", "expected -n N [-w W] command");
         return SMASH_FAIL;
     }
 
-    return SMASH_SUCCESS;
-}
+    //the command text is what jobs and error messages show
+    size_t len = 0;
+    for (int i = first; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char* text = arenaAlloc(&line_arena, len);
+    text[0] = '\0';
+    for (int i = first; i < argc; i++) {
+        if (i > first) strcat(text, " ");
+        strcat(text, argv[i]);
+    }
+    Stage stage = { .argv = argv + first, .argc = argc - first };
+    Command command = { .text = text, .stages = &stage, .stages_num = 1, .background = false };
 
+    double* wall = MALLOC_VALIDATED(double, runs * sizeof(double));
+    double user_total = 0, sys_total = 0, wall_total = 0;
+    CommandResult res = SMASH_SUCCESS;
+    for (int i = 0; i < warmup + runs; i++) {
+        double wall_ms, user_ms, sys_ms;
+        res = benchRun(&command, &wall_ms, &user_ms, &sys_ms);
+        if (res != SMASH_SUCCESS) {
+            if (res == SMASH_FAIL) {
+                perrorSmash("bench", arenaPrintf(&line_arena, "%s failed on run %d", text, i + 1));
+            }
+            free(wall);
+            return res;
+        }
+        if (i >= warmup) {
+            wall[i - warmup] = wall_ms;
+            wall_total += wall_ms;
+            user_total += user_ms;
+            sys_total += sys_ms;
+        }
+    }
 
-CommandResult executeCommand(char* cmd_line) {
-    cleanFinishedJobs();
+    qsort(wall, runs, sizeof(double), compareDoubles);
+    printf("%d runs of %s, %d warmup\n", runs, text, warmup);
+    printf("wall ms: min %.3f median %.3f p90 %.3f p99 %.3f max %.3f\n",
+        wall[0], percentile(wall, runs, 50), percentile(wall, runs, 90),
+        percentile(wall, runs, 99), wall[runs - 1]);
+    printf("cpu ms per run: user %.3f sys %.3f\n", user_total / runs, sys_total / runs);
+    printf("throughput: %.1f runs/s\n", wall_total > 0 ? runs * 1000.0 / wall_total : 0.0);
+    free(wall);
+    return SMASH_SUCCESS;
+}
 
-    char cmd_for_alias[CMD_LENGTH_MAX];
-    strncpy(cmd_for_alias, cmd_line, CMD_LENGTH_MAX);
-    cmd_for_alias[CMD_LENGTH_MAX-1] = '\0';
+//lexes, expands and parses line into arena, reports any error itself
+static bool parseLine(Arena* arena, char* line, CommandList* list) {
 
-    char* first_word = strtok(cmd_for_alias, " \t\n");
+    //the line is scanned once, everything after works on the tokens
+    TokenList tokens;
+    if (lexLine(arena, line, &tokens) != VALID_COMMAND) {
+        perrorSmash(line, "parsing error");
+        return false;
+    }
+    expandAliases(arena, &tokens);
+    if (parseTokens(arena, &tokens, list) != VALID_COMMAND) {
+        perrorSmash(line, "parsing error");
+        return false;
+    }
+    return true;
+}
 
-    if (first_word) {
-        Alias* alias = findAlias(first_word);
-        if (alias) {
-            char* args = cmd_line;
-            while(*args && (*args == ' ' || *args == '\t' || *args == '\n')) args++;
-            args += strlen(first_word);
+//runs a submitted line, which has to parse to a single command
+static CommandResult runSubmitted(char* line, bool background) {
+    CommandList list;
+    if (!parseLine(&line_arena, line, &list)) {
+        return SMASH_FAIL;
+    }
+    if (list.commands_num != 1) {
+        perrorSmash(line, "expected a single command");
+        return SMASH_FAIL;
+    }
+    Command command = list.commands[0];
+    command.background = background;
+    return executeSingleCommand(&command);
+}
 
-            char new_cmd[CMD_LENGTH_MAX];
-            sprintf(new_cmd, "%s%s", alias->command, args);
-            return executeCommand(new_cmd);
+/*
+ * starts queued jobs, highest priority first, while fewer than the running
+ * limit are running and the jobs list has room for them. a started job keeps
+ * the id it had in the queue, one that could not start for lack of resources
+ * goes back where it was and waits for the next try
+ */
+static void startQueuedJobs(void) {
+    Job* job;
+    while (runningJobsCount() < getRunningLimit() && !isJobsListFull() && (job = nextQueuedJob()) != NULL) {
+        const int job_id = job->job_id;
+        const int priority = job->priority;
+        const unsigned long seq = job->queue_seq;
+        char* line = arenaStrdup(&line_arena, job->command);
+        removeJobById(job_id);
+
+        reserveJobId(job_id);
+        errno = 0;
+        const CommandResult res = runSubmitted(line, true);
+        const int err = errno;
+        reserveJobId(-1);
+
+        //a builtin that ran and failed is done, running it again would repeat it
+        if (res == SMASH_FAIL && findJobById(job_id) == NULL && (err == EAGAIN || err == ENOMEM)) {
+            requeueJob(job_id, line, priority, seq);
+            break;
         }
     }
+}
 
-    char cmd_copy[CMD_LENGTH_MAX];
-    strncpy(cmd_copy, cmd_line, CMD_LENGTH_MAX);
-    cmd_copy[CMD_LENGTH_MAX-1] = '\0';
-
-    char* left = cmd_copy;
-    char* p = left;
-    bool in_single_quote = false;
-    bool in_double_quote = false;
-    CommandResult res = SMASH_SUCCESS;
+//argv as one line that lexes back into the same words
+static char* submittedLine(int argc, char* argv[]) {
+    size_t size = 1;
+    for (int i = 0; i < argc; i++) {
+        size += 4 * strlen(argv[i]) + 3;
+    }
+    char* line = arenaAlloc(&line_arena, size);
+    char* w = line;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) {
+            *w++ = ' ';
+        }
+        const char* word = argv[i];
+        if (*word && !strpbrk(word, " \t|&'\"")) {
+            w = stpcpy(w, word);
+            continue;
+        }
+        //single quoted, a ' inside becomes '"'"'
+        *w++ = '\'';
+        for (const char* c = word; *c; c++) {
+            if (*c == '\'') {
+                w = stpcpy(w, "'\"'\"'");
+            } else {
+                *w++ = *c;
+            }
+        }
+        *w++ = '\'';
+    }
+    *w = '\0';
+    return line;
+}
 
-    while (*p) {
-        if (*p == '\'' && !in_double_quote) {
-            in_single_quote = !in_single_quote;
-        } else if (*p == '\"' && !in_single_quote) {
-            in_double_quote = !in_double_quote;
+/*
+ * submit [-j N] [-p prio] cmd [args...] queues cmd as a background job. it
+ * starts once fewer than N background jobs run (the running limit, which -j
+ * changes for good), higher priorities first and in submission order among
+ * equals. a single argument is taken as a whole line, so a quoted pipeline
+ * can be queued too. submit alone shows the state of the queue
+ */
+CommandResult cmd_submit(int argc, char* argv[]) {
+
+    int priority = 0;
+    int i = 1;
+    while (i + 1 < argc && (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-p") == 0)) {
+        char* end;
+        long value = strtol(argv[i + 1], &end, 10);
+        if (!*argv[i + 1] || *end || (argv[i][1] == 'j' && value <= 0) || value > INT_MAX || value < INT_MIN) {
+            perrorSmash("submit", "invalid arguments");
+            return SMASH_FAIL;
+        }
+        if (argv[i][1] == 'j') {
+            setRunningLimit((int)value);
+        } else {
+            priority = (int)value;
         }
+        i += 2;
+    }
 
-        if (!in_single_quote && !in_double_quote && strncmp(p, "&&", 2) == 0) {
-            *p = '\0';
+    if (i == argc) {
+        if (argc == 1) {
+            printf("running %d/%d queued %d\n", runningJobsCount(), getRunningLimit(), queuedJobsCount());
+        }
+        startQueuedJobs();
+        return SMASH_SUCCESS;
+    }
 
-            res = executeSingleCommand(left);
+    //checked now, so a typo does not wait in the queue
+    char* line = i + 1 == argc ? argv[i] : submittedLine(argc - i, argv + i);
+    CommandList list;
+    if (!parseLine(&line_arena, arenaStrdup(&line_arena, line), &list)) {
+        return SMASH_FAIL;
+    }
+    if (list.commands_num != 1 || list.commands[0].background) {
+        perrorSmash("submit", "expected a single command");
+        return SMASH_FAIL;
+    }
 
-            if (res == SMASH_FAIL) return SMASH_FAIL;
-            if (res == SMASH_QUIT) return SMASH_QUIT;
+    addQueuedJob(line, priority);
+    startQueuedJobs();
+    return SMASH_SUCCESS;
+}
 
-            left = p + 2;
-            while(*left == ' ') left++;
+CommandResult executeCommand(char* cmd_line) {
+    cleanFinishedJobs();
 
-            p = left;
-            continue;
+    //a line seen before runs its cached plan as is
+    Plan* plan = findPlan(cmd_line);
+    if (!plan) {
+        plan = newPlan(cmd_line);
+        if (!parseLine(&plan->storage, plan->line, &plan->commands)) {
+            releasePlan(plan);
+            return SMASH_FAIL;
         }
-        p++;
+        cachePlan(plan);
     }
 
-    return executeSingleCommand(left);
+    CommandResult res = SMASH_SUCCESS;
+    for (int i = 0; i < plan->commands.commands_num; i++) {
+        res = executeSingleCommand(&plan->commands.commands[i]);
+        if (res != SMASH_SUCCESS) {
+            break;
+        }
+    }
+    releasePlan(plan);
+    return res;
 }
-
@@ -9,11 +9,11 @@
 #include <sys/types.h>
 #include <time.h>
 
-#include "my_system_call.h"
-
-#define CMD_LENGTH_MAX 120
-#define ARGS_NUM_MAX 20
-#define JOBS_NUM_MAX 100
+#include "syscallstats.h"
+#include "jobs.h"
+#include "alias.h"
+#include "arena.h"
+#include "parser.h"
 
 /*=============================================================================
 * error handling - some useful macros and examples of error handling,
@@ -42,12 +42,6 @@ static inline void* _validatedMalloc(size_t size)
 /*=============================================================================
 * error definitions
 =============================================================================*/
-typedef enum  {
-	INVALID_COMMAND = 0,
-    VALID_COMMAND,
-	//feel free to add more values here or delete this
-} ParsingError;
-
 typedef enum {
 	SMASH_SUCCESS = 0,
 	SMASH_QUIT,
@@ -55,32 +49,12 @@ typedef enum {
 	//feel free to add more values here or delete this
 } CommandResult;
 
-typedef enum {
-    BACKGROUND,
-    STOPPED
-} JobState;
-
-typedef struct Job {
-    int job_id;
-    pid_t pid;
-    char command[CMD_LENGTH_MAX];
-    time_t start_time;
-    JobState state;
-    struct Job* next;
-} Job;
-
-extern Job* job_list;
-
 extern pid_t foreground_pid;
-extern char foreground_cmd[CMD_LENGTH_MAX];
+extern const char* foreground_cmd;
 
+//holds the current command line, its copies and argv, reset once per line
+extern Arena line_arena;
 
-//ALIAS Type
-typedef struct Alias {
-    char alias[CMD_LENGTH_MAX];
-    char command[CMD_LENGTH_MAX];
-    struct Alias* next;
-} Alias;
 
 /*=============================================================================
 * global functions
@@ -95,10 +69,8 @@ ParsingError parseCommandExample(char* line);
 CommandResult executeCommand(char* command);
 
 void cleanFinishedJobs(void);
-void printJobs(void);
-Job* findJobById(int job_id);
-int addJob(pid_t pid, const char* command, JobState state);
-void removeJobById(int job_id);
+void printJobs(bool verbose);
+void printFinishedJobs(void);
 
 void perrorSmash(const char* command, const char* message);
 
@@ -0,0 +1,176 @@
+//filecmp.c
+#define _GNU_SOURCE
+#include "filecmp.h"
+#include "commands.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+	const char* a;
+	const char* b;
+	size_t len;
+	volatile int* differ; //shared by all workers, set on the first mismatch
+} CompareRange;
+
+static bool compareBlocks(const char* a, const char* b, size_t len, volatile int* differ) {
+	for(size_t off = 0; off < len; off += FILECMP_BLOCK) {
+		if(__atomic_load_n(differ, __ATOMIC_RELAXED)) {
+			return false;
+		}
+		size_t n = len - off < FILECMP_BLOCK ? len - off : FILECMP_BLOCK;
+		if(memcmp(a + off, b + off, n) != 0) {
+			__atomic_store_n(differ, 1, __ATOMIC_RELAXED);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void* compareWorker(void* arg) {
+	CompareRange* range = arg;
+	compareBlocks(range->a, range->b, range->len, range->differ);
+	return NULL;
+}
+
+static int compareThreads(size_t size) {
+	if(size < FILECMP_PARALLEL_MIN) {
+		return 1;
+	}
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	long by_size = size / (FILECMP_PARALLEL_MIN / 2);
+	long n = cpus < by_size ? cpus : by_size;
+	if(n > FILECMP_THREADS_MAX) {
+		n = FILECMP_THREADS_MAX;
+	}
+	return n < 1 ? 1 : (int)n;
+}
+
+static bool compareMapped(const char* a, const char* b, size_t size) {
+
+	volatile int differ = 0;
+	int threads = compareThreads(size);
+	if(threads == 1) {
+		return compareBlocks(a, b, size, &differ);
+	}
+
+	pthread_t tids[FILECMP_THREADS_MAX];
+	CompareRange ranges[FILECMP_THREADS_MAX];
+	size_t chunk = (size / threads + FILECMP_BLOCK - 1) / FILECMP_BLOCK * FILECMP_BLOCK;
+
+	int started = 0;
+	for(int i = 0; i < threads; i++) {
+		size_t off = i * chunk;
+		if(off >= size) {
+			break;
+		}
+		ranges[i].a = a + off;
+		ranges[i].b = b + off;
+		ranges[i].len = size - off < chunk ? size - off : chunk;
+		ranges[i].differ = &differ;
+		if(pthread_create(&tids[i], NULL, compareWorker, &ranges[i]) != 0) {
+			//no more threads, do the rest on this one
+			compareBlocks(ranges[i].a, ranges[i].b, size - off, &differ);
+			break;
+		}
+		started++;
+	}
+	for(int i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+	}
+	return !differ;
+}
+
+static bool readFull(int fd, char* buf, size_t len) {
+	size_t done = 0;
+	while(done < len) {
+		ssize_t n = my_system_call(SYS_READ, fd, buf + done, len - done);
+		if(n == -1 && errno == EINTR) {
+			//CTRL+C is answered once diff is done, it does not change the answer
+			continue;
+		}
+		if(n <= 0) {
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+//fallback when the files cannot be mapped
+static bool compareRead(int fd1, int fd2, size_t size) {
+
+	char* buf1 = NULL;
+	char* buf2 = NULL;
+	if(posix_memalign((void**)&buf1, 4096, FILECMP_BLOCK) != 0 ||
+	   posix_memalign((void**)&buf2, 4096, FILECMP_BLOCK) != 0) {
+		free(buf1);
+		return false;
+	}
+
+	bool equal = true;
+	for(size_t off = 0; off < size && equal; off += FILECMP_BLOCK) {
+		size_t n = size - off < FILECMP_BLOCK ? size - off : FILECMP_BLOCK;
+		equal = readFull(fd1, buf1, n) && readFull(fd2, buf2, n) &&
+			memcmp(buf1, buf2, n) == 0;
+	}
+	free(buf1);
+	free(buf2);
+	return equal;
+}
+
+bool areFilesEqual(const char* path1, const char* path2) {
+
+	int fd1 = my_system_call(SYS_OPEN, path1, O_RDONLY, 0);
+	int fd2 = my_system_call(SYS_OPEN, path2, O_RDONLY, 0);
+	struct stat st1, st2;
+
+	if(fd1 == -1 || fd2 == -1 || fstat(fd1, &st1) != 0 || fstat(fd2, &st2) != 0) {
+		if(fd1 != -1) {
+			my_system_call(SYS_CLOSE, fd1);
+		}
+		if(fd2 != -1) {
+			my_system_call(SYS_CLOSE, fd2);
+		}
+		return false;
+	}
+
+	bool equal;
+	if(st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino) {
+		equal = true;
+	} else if(st1.st_size != st2.st_size) {
+		equal = false;
+	} else if(st1.st_size == 0) {
+		equal = true;
+	} else {
+		size_t size = st1.st_size;
+		char* map1 = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd1, 0);
+		char* map2 = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd2, 0);
+
+		if(map1 != MAP_FAILED && map2 != MAP_FAILED) {
+			madvise(map1, size, MADV_SEQUENTIAL);
+			madvise(map2, size, MADV_SEQUENTIAL);
+			equal = compareMapped(map1, map2, size);
+		} else {
+			posix_fadvise(fd1, 0, 0, POSIX_FADV_SEQUENTIAL);
+			posix_fadvise(fd2, 0, 0, POSIX_FADV_SEQUENTIAL);
+			equal = compareRead(fd1, fd2, size);
+		}
+
+		if(map1 != MAP_FAILED) {
+			munmap(map1, size);
+		}
+		if(map2 != MAP_FAILED) {
+			munmap(map2, size);
+		}
+	}
+
+	my_system_call(SYS_CLOSE, fd1);
+	my_system_call(SYS_CLOSE, fd2);
+	return equal;
+}
@@ -0,0 +1,26 @@
+#ifndef FILECMP_H
+#define FILECMP_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+
+//files at least this big are compared by several threads at once
+#define FILECMP_PARALLEL_MIN (64L * 1024 * 1024)
+#define FILECMP_THREADS_MAX 8
+//unit of work between checks for an already found difference
+#define FILECMP_BLOCK (1L * 1024 * 1024)
+
+/*=============================================================================
+* global functions
+=============================================================================*/
+
+/*
+ * returns true if both regular files have identical contents.
+ * same inode and different sizes are answered from stat alone, otherwise the
+ * files are mapped (or read in large blocks when mapping fails) and compared
+ * with memcmp, split across threads for very large files.
+ */
+bool areFilesEqual(const char* path1, const char* path2);
+
+#endif //FILECMP_H
@@ -0,0 +1,482 @@
+//history.c
+#define _GNU_SOURCE
+#include "history.h"
+#include "commands.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_MAGIC 0x31485353u    //"SSH1"
+#define RECORD_WRAP UINT32_MAX       //nothing follows up to the end of the ring
+#define TRIGRAM_BUCKETS 4096
+#define INITIAL_ENTRIES 256
+#define INITIAL_POSTINGS 4
+
+/*=============================================================================
+* file layout: a header, then the ring of records. a record is its length as
+* a uint32_t followed by the line, padded to 4 bytes. records are written at
+* head, the oldest ones at tail are dropped as head runs into them.
+*
+* every shell using the file maps it shared and holds an flock on it while
+* it appends or searches, other shells may have changed it in between.
+=============================================================================*/
+typedef struct {
+	uint32_t magic;
+	uint32_t size;   //bytes in the ring after the header
+	uint32_t head;   //where the next record goes
+	uint32_t tail;   //the oldest record
+	uint64_t first;  //number of the oldest line
+	uint64_t next;   //number the next line gets
+} HistoryHeader;
+
+static HistoryHeader* header = NULL;
+static char* ring = NULL;
+static int history_fd = -1; //kept open for flock, -1 for a history in memory
+
+/*=============================================================================
+* in-memory index, built on first search
+=============================================================================*/
+typedef struct {
+	uint32_t offset;
+	uint32_t len;
+} IndexEntry;
+
+//lines in increasing number order, older ones are stale once evicted
+typedef struct {
+	uint64_t* numbers;
+	size_t start;  //first entry that may still be live
+	size_t len;
+	size_t cap;
+} Posting;
+
+static bool indexed = false;
+static IndexEntry* entries = NULL;  //line header->first is at entries[entries_start]
+static size_t entries_start = 0;
+static size_t entries_end = 0;
+static size_t entries_cap = 0;
+static Posting trigrams[TRIGRAM_BUCKETS];
+//header->first and header->next as of the last time the index caught up
+static uint64_t indexed_first = 0;
+static uint64_t indexed_next = 0;
+
+static uint32_t recordSize(size_t len) {
+	return (uint32_t)((sizeof(uint32_t) + len + 3) & ~(size_t)3);
+}
+
+static uint32_t recordLen(uint32_t offset) {
+	uint32_t len;
+	memcpy(&len, ring + offset, sizeof(len));
+	return len;
+}
+
+static const char* recordText(uint32_t offset) {
+	return ring + offset + sizeof(uint32_t);
+}
+
+//where the record at offset really starts, past the end of the ring
+static uint32_t normalize(uint32_t offset) {
+	if(offset + sizeof(uint32_t) > header->size || recordLen(offset) == RECORD_WRAP) {
+		return 0;
+	}
+	return offset;
+}
+
+static bool isEmpty(void) {
+	return header->first == header->next;
+}
+
+static unsigned trigramHash(const char* s) {
+	uint32_t t = ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+	return (t * 2654435761u) >> (32 - 12);
+}
+
+static void postingAdd(Posting* p, uint64_t number) {
+	while(p->start < p->len && p->numbers[p->start] < header->first) {
+		p->start++;
+	}
+	if(p->len == p->cap) {
+		//compact only when it frees half, so appends stay O(1) amortized
+		if(p->start > 0 && p->start >= p->cap / 2) {
+			memmove(p->numbers, p->numbers + p->start, (p->len - p->start) * sizeof(uint64_t));
+			p->len -= p->start;
+			p->start = 0;
+		} else {
+			p->cap = p->cap ? p->cap * 2 : INITIAL_POSTINGS;
+			p->numbers = realloc(p->numbers, p->cap * sizeof(uint64_t));
+			if(!p->numbers) ERROR_EXIT("realloc");
+		}
+	}
+	p->numbers[p->len++] = number;
+}
+
+static void indexLine(uint64_t number, uint32_t offset, uint32_t len) {
+	if(entries_end == entries_cap) {
+		if(entries_start > 0 && entries_start >= entries_cap / 2) {
+			memmove(entries, entries + entries_start, (entries_end - entries_start) * sizeof(IndexEntry));
+			entries_end -= entries_start;
+			entries_start = 0;
+		} else {
+			entries_cap = entries_cap ? entries_cap * 2 : INITIAL_ENTRIES;
+			entries = realloc(entries, entries_cap * sizeof(IndexEntry));
+			if(!entries) ERROR_EXIT("realloc");
+		}
+	}
+	entries[entries_end].offset = offset;
+	entries[entries_end].len = len;
+	entries_end++;
+
+	const char* text = recordText(offset);
+	for(uint32_t i = 0; i + 3 <= len; i++) {
+		Posting* p = &trigrams[trigramHash(text + i)];
+		//a trigram seen twice in the line is listed once
+		if(p->len > p->start && p->numbers[p->len - 1] == number) {
+			continue;
+		}
+		postingAdd(p, number);
+	}
+}
+
+static const IndexEntry* entryOf(uint64_t number) {
+	return &entries[entries_start + (number - header->first)];
+}
+
+static void clearIndex(void) {
+	entries_start = entries_end = 0;
+	for(int i = 0; i < TRIGRAM_BUCKETS; i++) {
+		trigrams[i].start = trigrams[i].len = 0;
+	}
+}
+
+/*=============================================================================
+* locking, the file is shared with every other shell that uses it
+=============================================================================*/
+static void lockHistory(void) {
+	if(history_fd == -1) {
+		return;
+	}
+	while(flock(history_fd, LOCK_EX) == -1 && errno == EINTR) {
+	}
+}
+
+static void unlockHistory(void) {
+	if(history_fd != -1) {
+		flock(history_fd, LOCK_UN);
+	}
+}
+
+/*=============================================================================
+* the ring
+=============================================================================*/
+static void resetHistory(uint32_t size) {
+	header->magic = HISTORY_MAGIC;
+	header->size = size;
+	header->head = 0;
+	header->tail = 0;
+	header->first = 1;
+	header->next = 1;
+}
+
+static bool isValidHeader(uint32_t size) {
+	return header->magic == HISTORY_MAGIC && header->size == size &&
+		header->head < size && header->tail < size &&
+		header->head % 4 == 0 && header->tail % 4 == 0 &&
+		header->first >= 1 && header->first <= header->next;
+}
+
+static void evictOldest(void) {
+	uint32_t tail = normalize(header->tail);
+	header->tail = tail + recordSize(recordLen(tail));
+	header->first++;
+	if(indexed) {
+		entries_start++;
+	}
+	if(isEmpty()) {
+		header->tail = header->head;
+	} else {
+		header->tail = normalize(header->tail);
+	}
+}
+
+//indexes the lines from number on, the first of them is at offset
+static void indexFrom(uint64_t number, uint32_t offset) {
+	for(; number < header->next; number++) {
+		offset = normalize(offset);
+		uint32_t len = recordLen(offset);
+		if(len > header->size / 2 || offset + recordSize(len) > header->size) {
+			//a damaged file, start over rather than trust any of it
+			perrorSmash("history", "history file is damaged, starting a new one");
+			resetHistory(header->size);
+			clearIndex();
+			break;
+		}
+		indexLine(number, offset, len);
+		offset += recordSize(len);
+	}
+	indexed_first = header->first;
+	indexed_next = header->next;
+}
+
+/*
+ * brings the index up to date with the file, on first use or after other
+ * shells appended to it. their evictions only move the start of the index,
+ * their lines are indexed from the end of the last one we know. called with
+ * the lock held, before anything looks at the index
+ */
+static void syncIndex(void) {
+	if(!indexed) {
+		indexed = true;
+		clearIndex();
+		indexFrom(header->first, header->tail);
+		return;
+	}
+	if(header->first == indexed_first && header->next == indexed_next) {
+		return;
+	}
+	if(header->first < indexed_first || header->next < indexed_next || header->first > indexed_next) {
+		//rewritten or gone past everything we had, index it all again
+		clearIndex();
+		indexFrom(header->first, header->tail);
+		return;
+	}
+
+	entries_start += header->first - indexed_first;
+	uint32_t offset = header->tail;
+	if(entries_end > entries_start) {
+		const IndexEntry* last = &entries[entries_end - 1];
+		offset = last->offset + recordSize(last->len);
+	}
+	indexFrom(indexed_next, offset);
+}
+
+void initHistory(void) {
+
+	const char* path = getenv("SMASH_HISTORY");
+	char* home_path = NULL;
+	if(!path && getenv("HOME")) {
+		const char* home = getenv("HOME");
+		home_path = MALLOC_VALIDATED(char, strlen(home) + sizeof(HISTORY_FILE_NAME) + 1);
+		sprintf(home_path, "%s/%s", home, HISTORY_FILE_NAME);
+		path = home_path;
+	}
+
+	const size_t map_size = sizeof(HistoryHeader) + HISTORY_RING_SIZE;
+	void* map = MAP_FAILED;
+	bool fresh = false;
+	history_fd = path && *path ? my_system_call(SYS_OPEN, path, O_RDWR | O_CREAT | O_CLOEXEC, 0600) : -1;
+	//another shell may be setting up the same file
+	lockHistory();
+	struct stat st;
+	if(history_fd != -1 && fstat(history_fd, &st) == 0) {
+		//an empty file is ours to set up, anything else of the wrong size is not
+		if(st.st_size == 0 && ftruncate(history_fd, map_size) == 0) {
+			fresh = true;
+			st.st_size = map_size;
+		}
+		if((size_t)st.st_size == map_size) {
+			map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, history_fd, 0);
+		}
+	}
+
+	if(map != MAP_FAILED) {
+		header = map;
+		ring = (char*)map + sizeof(HistoryHeader);
+		if(fresh) {
+			resetHistory(HISTORY_RING_SIZE);
+		} else if(!isValidHeader(HISTORY_RING_SIZE)) {
+			munmap(map, map_size);
+			map = MAP_FAILED;
+		}
+	}
+	unlockHistory();
+	if(map == MAP_FAILED && history_fd != -1) {
+		my_system_call(SYS_CLOSE, history_fd);
+		history_fd = -1;
+	}
+	if(map == MAP_FAILED) {
+		if(path && *path) {
+			perrorSmash(path, "cannot use history file, history is kept in memory");
+		}
+		map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(map == MAP_FAILED) {
+			header = NULL;
+		} else {
+			header = map;
+			ring = (char*)map + sizeof(HistoryHeader);
+			resetHistory(HISTORY_RING_SIZE);
+		}
+	}
+	free(home_path);
+}
+
+void addHistory(const char* line) {
+	if(!header) {
+		return;
+	}
+	size_t len = strlen(line);
+	uint32_t size = recordSize(len);
+	if(len == 0 || size > header->size / 2) {
+		return;
+	}
+
+	lockHistory();
+	if(indexed) {
+		syncIndex();
+	}
+
+	if(header->head + size > header->size) {
+		//wrap around, everything from head to the end of the ring goes first
+		while(!isEmpty() && header->tail >= header->head) {
+			evictOldest();
+		}
+		if(header->head + sizeof(uint32_t) <= header->size) {
+			uint32_t wrap = RECORD_WRAP;
+			memcpy(ring + header->head, &wrap, sizeof(wrap));
+		}
+		header->head = 0;
+		if(isEmpty()) {
+			header->tail = 0;
+		}
+	}
+	while(!isEmpty() && header->tail >= header->head && header->tail < header->head + size) {
+		evictOldest();
+	}
+
+	uint32_t offset = header->head;
+	uint32_t len32 = (uint32_t)len;
+	memcpy(ring + offset, &len32, sizeof(len32));
+	memcpy(ring + offset + sizeof(uint32_t), line, len);
+	if(isEmpty()) {
+		header->tail = offset;
+	}
+	header->head = offset + size;
+	if(indexed) {
+		indexLine(header->next, offset, len32);
+	}
+	//last, so a line is never visible half written
+	header->next++;
+	indexed_first = header->first;
+	indexed_next = header->next;
+	unlockHistory();
+}
+
+/*=============================================================================
+* searching
+=============================================================================*/
+typedef bool (*LineMatch)(const char* line, size_t len, const char* text, size_t text_len);
+
+static bool startsWith(const char* line, size_t len, const char* text, size_t text_len) {
+	return len >= text_len && memcmp(line, text, text_len) == 0;
+}
+
+static bool contains(const char* line, size_t len, const char* text, size_t text_len) {
+	return memmem(line, len, text, text_len) != NULL;
+}
+
+static bool lineMatches(uint64_t number, LineMatch match, const char* text, size_t text_len) {
+	const IndexEntry* entry = entryOf(number);
+	return match(recordText(entry->offset), entry->len, text, text_len);
+}
+
+/*
+ * stores in found the lines numbered below before that match text, newest
+ * first, at most max of them. returns how many there are
+ */
+static size_t findLines(const char* text, LineMatch match, uint64_t before, uint64_t* found, size_t max) {
+	if(before > header->next) {
+		before = header->next;
+	}
+	size_t text_len = strlen(text);
+	size_t found_num = 0;
+
+	//every match contains every trigram of text, the rarest one is enough
+	Posting* best = NULL;
+	for(size_t i = 0; i + 3 <= text_len; i++) {
+		Posting* p = &trigrams[trigramHash(text + i)];
+		if(!best || p->len - p->start < best->len - best->start) {
+			best = p;
+		}
+	}
+
+	if(best) {
+		for(size_t i = best->len; i > best->start && found_num < max; i--) {
+			uint64_t number = best->numbers[i - 1];
+			if(number < header->first) {
+				break;
+			}
+			if(number < before && lineMatches(number, match, text, text_len)) {
+				found[found_num++] = number;
+			}
+		}
+		return found_num;
+	}
+
+	//too short to have a trigram, but then any line is a quick check
+	for(uint64_t number = before; number > header->first && found_num < max; number--) {
+		if(lineMatches(number - 1, match, text, text_len)) {
+			found[found_num++] = number - 1;
+		}
+	}
+	return found_num;
+}
+
+char* recallHistory(Arena* arena, const char* event) {
+	if(!header || event[0] != '!') {
+		return NULL;
+	}
+	lockHistory();
+	syncIndex();
+	if(isEmpty()) {
+		unlockHistory();
+		return NULL;
+	}
+
+	const char* spec = event + 1;
+	uint64_t number = 0;
+	if(strcmp(spec, "!") == 0) {
+		number = header->next - 1;
+	} else if(*spec && spec[strspn(spec, "0123456789")] == '\0') {
+		number = strtoull(spec, NULL, 10);
+	} else if(*spec) {
+		findLines(spec, startsWith, header->next, &number, 1);
+	}
+
+	char* line = NULL;
+	if(number >= header->first && number < header->next) {
+		const IndexEntry* entry = entryOf(number);
+		line = arenaStrndup(arena, recordText(entry->offset), entry->len);
+	}
+	unlockHistory();
+	return line;
+}
+
+void printHistory(const char* text) {
+	if(!header) {
+		return;
+	}
+	lockHistory();
+	syncIndex();
+
+	if(!text) {
+		for(uint64_t number = header->first; number < header->next; number++) {
+			const IndexEntry* entry = entryOf(number);
+			printf("%5llu  %.*s\n", (unsigned long long)number, (int)entry->len, recordText(entry->offset));
+		}
+		unlockHistory();
+		return;
+	}
+
+	//found newest first, printed oldest first
+	uint64_t* numbers = MALLOC_VALIDATED(uint64_t, (header->next - header->first) * sizeof(uint64_t));
+	size_t found = findLines(text, contains, header->next, numbers, header->next - header->first);
+	while(found > 0) {
+		const IndexEntry* entry = entryOf(numbers[--found]);
+		printf("%5llu  %.*s\n", (unsigned long long)numbers[found], (int)entry->len, recordText(entry->offset));
+	}
+	free(numbers);
+	unlockHistory();
+}
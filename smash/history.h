@@ -0,0 +1,51 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+//bytes of command lines kept, the oldest lines are overwritten first
+#define HISTORY_RING_SIZE (1024 * 1024)
+//where the history goes unless SMASH_HISTORY names another file
+#define HISTORY_FILE_NAME ".smash_history"
+
+/*=============================================================================
+* command history
+*
+* interactive lines are appended to a ring of length prefixed records in a
+* fixed size file that is mapped shared, so appending is a memcpy and a
+* header update and opening it reads nothing but the header. lines are
+* numbered from 1 for good, the numbers survive restarts.
+*
+* searching goes through an in-memory index built on first use: one entry
+* per line for !n, and a hash of every trigram of every line to the lines
+* that contain it, so !prefix and history text only look at the lines that
+* share the rarest trigram of what is searched for.
+=============================================================================*/
+
+/*
+ * maps the history file, falls back to a history in memory only if the file
+ * cannot be used
+ */
+void initHistory(void);
+
+void addHistory(const char* line);
+
+/*
+ * returns the line event refers to, copied into arena, or NULL if there is
+ * none. event is !! (the last line), !n (line number n) or !prefix (the
+ * last line that starts with prefix)
+ */
+char* recallHistory(Arena* arena, const char* event);
+
+/*
+ * prints every line, or every line that contains text, oldest first
+ */
+void printHistory(const char* text);
+
+#endif //HISTORY_H
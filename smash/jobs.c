@@ -0,0 +1,634 @@
+//jobs.c
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "commands.h"
+#include "affinity.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define BITS_PER_WORD 64
+#define INITIAL_WORDS 1
+#define INITIAL_INDEX_SIZE 64
+
+/*=============================================================================
+* two level id bitmap
+=============================================================================*/
+typedef struct {
+	uint64_t* bits;     //bit i set -> id i is in the set
+	uint64_t* nonempty; //bit w set -> bits[w] != 0
+	uint64_t* nonfull;  //bit w set -> bits[w] has a clear bit
+	int words;
+} IdBitmap;
+
+static int summaryWords(int words) {
+	return (words + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+static void bitmapGrow(IdBitmap* b, int words) {
+	int old_words = b->words;
+	int old_summary = summaryWords(old_words);
+	int summary = summaryWords(words);
+
+	b->bits = realloc(b->bits, words * sizeof(uint64_t));
+	b->nonempty = realloc(b->nonempty, summary * sizeof(uint64_t));
+	b->nonfull = realloc(b->nonfull, summary * sizeof(uint64_t));
+	if(!b->bits || !b->nonempty || !b->nonfull) ERROR_EXIT("realloc");
+
+	memset(b->bits + old_words, 0, (words - old_words) * sizeof(uint64_t));
+	memset(b->nonempty + old_summary, 0, (summary - old_summary) * sizeof(uint64_t));
+	memset(b->nonfull + old_summary, 0, (summary - old_summary) * sizeof(uint64_t));
+	for(int w = old_words; w < words; w++) {
+		b->nonfull[w / BITS_PER_WORD] |= 1ULL << (w % BITS_PER_WORD);
+	}
+	b->words = words;
+}
+
+static void bitmapFree(IdBitmap* b) {
+	free(b->bits);
+	free(b->nonempty);
+	free(b->nonfull);
+	memset(b, 0, sizeof(*b));
+}
+
+static void bitmapSet(IdBitmap* b, int id) {
+	int w = id / BITS_PER_WORD;
+	b->bits[w] |= 1ULL << (id % BITS_PER_WORD);
+	b->nonempty[w / BITS_PER_WORD] |= 1ULL << (w % BITS_PER_WORD);
+	if(b->bits[w] == UINT64_MAX) {
+		b->nonfull[w / BITS_PER_WORD] &= ~(1ULL << (w % BITS_PER_WORD));
+	}
+}
+
+static void bitmapClear(IdBitmap* b, int id) {
+	int w = id / BITS_PER_WORD;
+	b->bits[w] &= ~(1ULL << (id % BITS_PER_WORD));
+	b->nonfull[w / BITS_PER_WORD] |= 1ULL << (w % BITS_PER_WORD);
+	if(b->bits[w] == 0) {
+		b->nonempty[w / BITS_PER_WORD] &= ~(1ULL << (w % BITS_PER_WORD));
+	}
+}
+
+//lowest id not in the set, equals the capacity when the bitmap is full
+static int bitmapFirstClear(const IdBitmap* b) {
+	for(int s = 0; s < summaryWords(b->words); s++) {
+		if(b->nonfull[s]) {
+			int w = s * BITS_PER_WORD + __builtin_ctzll(b->nonfull[s]);
+			return w * BITS_PER_WORD + __builtin_ctzll(~b->bits[w]);
+		}
+	}
+	return b->words * BITS_PER_WORD;
+}
+
+//highest id in the set, -1 when empty
+static int bitmapLast(const IdBitmap* b) {
+	for(int s = summaryWords(b->words) - 1; s >= 0; s--) {
+		if(b->nonempty[s]) {
+			int w = s * BITS_PER_WORD + (BITS_PER_WORD - 1 - __builtin_clzll(b->nonempty[s]));
+			return w * BITS_PER_WORD + (BITS_PER_WORD - 1 - __builtin_clzll(b->bits[w]));
+		}
+	}
+	return -1;
+}
+
+//lowest id in the set that is >= id, -1 when there is none
+static int bitmapNext(const IdBitmap* b, int id) {
+	int w = id / BITS_PER_WORD;
+	if(w >= b->words) {
+		return -1;
+	}
+	uint64_t m = b->bits[w] & (UINT64_MAX << (id % BITS_PER_WORD));
+	if(m) {
+		return w * BITS_PER_WORD + __builtin_ctzll(m);
+	}
+
+	w++;
+	for(int s = w / BITS_PER_WORD; s < summaryWords(b->words); s++) {
+		uint64_t sm = b->nonempty[s];
+		if(s == w / BITS_PER_WORD) {
+			sm &= UINT64_MAX << (w % BITS_PER_WORD);
+		}
+		if(sm) {
+			int nw = s * BITS_PER_WORD + __builtin_ctzll(sm);
+			return nw * BITS_PER_WORD + __builtin_ctzll(b->bits[nw]);
+		}
+	}
+	return -1;
+}
+
+/*=============================================================================
+* job table state
+=============================================================================*/
+static Job** slots = NULL;    //indexed by job id
+static IdBitmap used_ids;     //ids that hold a job
+static IdBitmap stopped_ids;  //ids of jobs in the STOPPED state
+static int jobs_count = 0;
+static int state_counts[QUEUED + 1];
+static int jobs_limit = JOBS_NUM_MAX;
+static int reserved_id = -1;
+static int running_limit = 1;
+static pid_t queue_owner = 0;  //the shell, forked builtins must not start queued jobs
+
+//queued jobs, a binary heap ordered by jobStartsBefore()
+static Job** queue = NULL;
+static int queue_len = 0;
+static int queue_cap = 0;
+static unsigned long queue_seq = 0;
+
+//pid -> job for every live process of every job, open addressing with linear probing
+typedef struct {
+	pid_t pid; //0 marks an empty slot
+	Job* job;
+} PidEntry;
+
+static PidEntry* pid_index = NULL;
+static size_t pid_index_size = 0;
+static size_t pid_index_count = 0;
+
+//ring of the last FINISHED_JOBS_MAX finished jobs
+static FinishedJob finished[FINISHED_JOBS_MAX];
+static int finished_next = 0;  //slot the next finished job goes to
+static int finished_count = 0;
+
+static int tableCapacity(void) {
+	return used_ids.words * BITS_PER_WORD;
+}
+
+static void growTable(int words) {
+	int old_capacity = tableCapacity();
+	bitmapGrow(&used_ids, words);
+	bitmapGrow(&stopped_ids, words);
+
+	slots = realloc(slots, tableCapacity() * sizeof(Job*));
+	if(!slots) ERROR_EXIT("realloc");
+	memset(slots + old_capacity, 0, (tableCapacity() - old_capacity) * sizeof(Job*));
+}
+
+/*=============================================================================
+* pid index
+=============================================================================*/
+static size_t pidSlot(pid_t pid) {
+	return ((uint32_t)pid * 2654435761u) & (pid_index_size - 1);
+}
+
+static void pidIndexInsert(pid_t pid, Job* job);
+
+static void pidIndexResize(size_t size) {
+	PidEntry* old = pid_index;
+	size_t old_size = pid_index_size;
+
+	pid_index = calloc(size, sizeof(PidEntry));
+	if(!pid_index) ERROR_EXIT("calloc");
+	pid_index_size = size;
+	pid_index_count = 0;
+
+	for(size_t i = 0; i < old_size; i++) {
+		if(old[i].pid) {
+			pidIndexInsert(old[i].pid, old[i].job);
+		}
+	}
+	free(old);
+}
+
+static void pidIndexInsert(pid_t pid, Job* job) {
+	//keep the load factor under one half
+	if(pid_index_size < 2 * (pid_index_count + 1)) {
+		pidIndexResize(pid_index_size ? pid_index_size * 2 : INITIAL_INDEX_SIZE);
+	}
+	size_t i = pidSlot(pid);
+	while(pid_index[i].pid) {
+		i = (i + 1) & (pid_index_size - 1);
+	}
+	pid_index[i].pid = pid;
+	pid_index[i].job = job;
+	pid_index_count++;
+}
+
+static PidEntry* pidIndexFind(pid_t pid) {
+	if(!pid_index_size || pid <= 0) {
+		return NULL;
+	}
+	size_t i = pidSlot(pid);
+	while(pid_index[i].pid) {
+		if(pid_index[i].pid == pid) {
+			return &pid_index[i];
+		}
+		i = (i + 1) & (pid_index_size - 1);
+	}
+	return NULL;
+}
+
+static void pidIndexRemove(pid_t pid) {
+	PidEntry* entry = pidIndexFind(pid);
+	if(!entry) {
+		return;
+	}
+	size_t i = entry - pid_index;
+	pid_index[i].pid = 0;
+	pid_index_count--;
+
+	//backward shift deletion, no tombstones needed
+	size_t j = i;
+	while(1) {
+		j = (j + 1) & (pid_index_size - 1);
+		if(!pid_index[j].pid) {
+			return;
+		}
+		size_t home = pidSlot(pid_index[j].pid);
+		bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+		if(movable) {
+			pid_index[i] = pid_index[j];
+			pid_index[j].pid = 0;
+			i = j;
+		}
+	}
+}
+
+/*=============================================================================
+* queue of QUEUED jobs
+=============================================================================*/
+static bool jobStartsBefore(const Job* a, const Job* b) {
+	if(a->priority != b->priority) {
+		return a->priority > b->priority;
+	}
+	return a->queue_seq < b->queue_seq;
+}
+
+static void queueSet(int i, Job* job) {
+	queue[i] = job;
+	job->queue_slot = i;
+}
+
+static void queueSiftUp(int i) {
+	Job* job = queue[i];
+	while(i > 0 && jobStartsBefore(job, queue[(i - 1) / 2])) {
+		queueSet(i, queue[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	queueSet(i, job);
+}
+
+static void queueSiftDown(int i) {
+	Job* job = queue[i];
+	while(2 * i + 1 < queue_len) {
+		int child = 2 * i + 1;
+		if(child + 1 < queue_len && jobStartsBefore(queue[child + 1], queue[child])) {
+			child++;
+		}
+		if(!jobStartsBefore(queue[child], job)) {
+			break;
+		}
+		queueSet(i, queue[child]);
+		i = child;
+	}
+	queueSet(i, job);
+}
+
+static void queuePush(Job* job) {
+	if(queue_len == queue_cap) {
+		queue_cap = queue_cap ? queue_cap * 2 : INITIAL_INDEX_SIZE;
+		queue = realloc(queue, queue_cap * sizeof(Job*));
+		if(!queue) ERROR_EXIT("realloc");
+	}
+	queueSet(queue_len++, job);
+	queueSiftUp(job->queue_slot);
+}
+
+static void queueRemove(Job* job) {
+	int i = job->queue_slot;
+	job->queue_slot = -1;
+	Job* last = queue[--queue_len];
+	if(i == queue_len) {
+		return;
+	}
+	queueSet(i, last);
+	queueSiftUp(i);
+	queueSiftDown(last->queue_slot);
+}
+
+/*=============================================================================
+* public functions
+=============================================================================*/
+//a positive limit from the environment variable name, or def
+static int limitFromEnv(const char* name, int def) {
+	const char* limit = getenv(name);
+	if(limit) {
+		char* end;
+		long value = strtol(limit, &end, 10);
+		if(*limit && !*end && value > 0 && value <= 1000000) {
+			return (int)value;
+		}
+		perrorSmash(name, "invalid value, using default");
+	}
+	return def;
+}
+
+void initJobs(void) {
+	setJobsLimit(limitFromEnv("SMASH_JOBS_MAX", JOBS_NUM_MAX));
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	setRunningLimit(limitFromEnv("SMASH_RUNNING_MAX", cpus > 0 ? (int)cpus : 1));
+	queue_owner = getpid();
+}
+
+void setRunningLimit(int limit) {
+	running_limit = limit;
+}
+
+int getRunningLimit(void) {
+	return running_limit;
+}
+
+void setJobsLimit(int limit) {
+	jobs_limit = limit;
+}
+
+int getJobsLimit(void) {
+	return jobs_limit;
+}
+
+int jobsCount(void) {
+	return jobs_count;
+}
+
+bool isJobsListFull(void) {
+	return jobs_count - state_counts[QUEUED] >= jobs_limit;
+}
+
+int runningJobsCount(void) {
+	return state_counts[BACKGROUND];
+}
+
+int queuedJobsCount(void) {
+	return state_counts[QUEUED];
+}
+
+int addJob(pid_t pid, const char* command, JobState state) {
+	return addJobGroup(pid, &pid, 1, command, state);
+}
+
+int addJobGroup(pid_t pgid, const pid_t* pids, int pids_num, const char* command, JobState state) {
+
+	if(state != QUEUED && isJobsListFull()) {
+		return -1;
+	}
+	if(tableCapacity() == 0) {
+		growTable(INITIAL_WORDS);
+	}
+
+	int job_id = bitmapFirstClear(&used_ids);
+	if(reserved_id != -1 && findJobById(reserved_id) == NULL && reserved_id < tableCapacity()) {
+		job_id = reserved_id;
+	}
+	reserved_id = -1;
+	if(job_id >= tableCapacity()) {
+		growTable(used_ids.words * 2);
+	}
+
+	size_t len = strlen(command);
+	Job* newJob = MALLOC_VALIDATED(Job, sizeof(Job) + pids_num * sizeof(pid_t));
+	newJob->job_id = job_id;
+	newJob->pid = pgid;
+	newJob->command = MALLOC_VALIDATED(char, len + 1);
+	memcpy(newJob->command, command, len + 1);
+	newJob->start_time = time(NULL);
+	newJob->state = state;
+	newJob->pids_num = pids_num;
+	newJob->alive = 0;
+	newJob->status = 0;
+	memset(&newJob->usage, 0, sizeof(newJob->usage));
+	newJob->task = NULL;
+	newJob->cpus = NULL;
+	newJob->priority = 0;
+	newJob->queue_seq = 0;
+	newJob->queue_slot = -1;
+	memcpy(newJob->pids, pids, pids_num * sizeof(pid_t));
+
+	slots[job_id] = newJob;
+	bitmapSet(&used_ids, job_id);
+	if(state == STOPPED) {
+		bitmapSet(&stopped_ids, job_id);
+	}
+	for(int i = 0; i < pids_num; i++) {
+		if(pids[i]) {
+			pidIndexInsert(pids[i], newJob);
+			newJob->alive++;
+		}
+	}
+	jobs_count++;
+	state_counts[state]++;
+
+	return job_id;
+}
+
+int addThreadJob(struct ThreadTask* task, const char* command) {
+	pid_t pid = getpid();
+	int job_id = addJobGroup(pid, &pid, 0, command, BACKGROUND);
+	if(job_id != -1) {
+		slots[job_id]->task = task;
+	}
+	return job_id;
+}
+
+void reserveJobId(int job_id) {
+	reserved_id = job_id;
+}
+
+static int queueJob(const char* command, int priority, unsigned long seq) {
+	pid_t none = 0;
+	int job_id = addJobGroup(0, &none, 0, command, QUEUED);
+	Job* job = findJobById(job_id);
+	job->priority = priority;
+	job->queue_seq = seq;
+	queuePush(job);
+	return job_id;
+}
+
+int addQueuedJob(const char* command, int priority) {
+	return queueJob(command, priority, queue_seq++);
+}
+
+void requeueJob(int job_id, const char* command, int priority, unsigned long seq) {
+	reserveJobId(job_id);
+	queueJob(command, priority, seq);
+	reserveJobId(-1);
+}
+
+Job* nextQueuedJob(void) {
+	if(queue_len == 0 || getpid() != queue_owner) {
+		return NULL;
+	}
+	return queue[0];
+}
+
+void removeJobById(int job_id) {
+
+	Job* job = findJobById(job_id);
+	if(job == NULL) {
+		return;
+	}
+
+	for(int i = 0; i < job->pids_num; i++) {
+		if(job->pids[i]) {
+			pidIndexRemove(job->pids[i]);
+		}
+	}
+	if(job->queue_slot != -1) {
+		queueRemove(job);
+	}
+	bitmapClear(&used_ids, job_id);
+	bitmapClear(&stopped_ids, job_id);
+	slots[job_id] = NULL;
+	jobs_count--;
+	state_counts[job->state]--;
+
+	setJobCpus(job, NULL);
+	free(job->command);
+	free(job);
+}
+
+void setJobCpus(Job* job, const CpuSet* cpus) {
+	if(job->cpus) {
+		releaseCpus(job->cpus);
+	}
+	if(!cpus) {
+		free(job->cpus);
+		job->cpus = NULL;
+		return;
+	}
+	if(!job->cpus) {
+		job->cpus = MALLOC_VALIDATED(CpuSet, sizeof(CpuSet));
+	}
+	*job->cpus = *cpus;
+	takeCpus(job->cpus);
+}
+
+bool jobProcessExited(Job* job, pid_t pid, int status, const struct rusage* usage) {
+	for(int i = 0; i < job->pids_num; i++) {
+		if(job->pids[i] == pid) {
+			//a pipeline ends the way its last stage does
+			if(i == job->pids_num - 1) {
+				job->status = status;
+			}
+			addUsage(&job->usage, usage);
+			job->pids[i] = 0;
+			job->alive--;
+			pidIndexRemove(pid);
+			break;
+		}
+	}
+	return job->alive == 0;
+}
+
+void finishJob(Job* job) {
+	FinishedJob* entry = &finished[finished_next];
+	free(entry->command);
+
+	entry->job_id = job->job_id;
+	entry->pid = job->pid;
+	entry->command = job->command;
+	entry->start_time = job->start_time;
+	entry->end_time = time(NULL);
+	entry->status = job->status;
+	entry->usage = job->usage;
+
+	//the ring takes over the command string
+	job->command = NULL;
+	removeJobById(job->job_id);
+
+	finished_next = (finished_next + 1) % FINISHED_JOBS_MAX;
+	if(finished_count < FINISHED_JOBS_MAX) {
+		finished_count++;
+	}
+}
+
+void addUsage(struct rusage* total, const struct rusage* usage) {
+	timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+	timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+	if(usage->ru_maxrss > total->ru_maxrss) {
+		total->ru_maxrss = usage->ru_maxrss;
+	}
+	total->ru_nvcsw += usage->ru_nvcsw;
+	total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+int finishedJobsCount(void) {
+	return finished_count;
+}
+
+const FinishedJob* finishedJob(int i) {
+	if(i < 0 || i >= finished_count) {
+		return NULL;
+	}
+	int oldest = (finished_next - finished_count + FINISHED_JOBS_MAX) % FINISHED_JOBS_MAX;
+	return &finished[(oldest + i) % FINISHED_JOBS_MAX];
+}
+
+void clearJobs(void) {
+	for(Job* job = firstJob(); job != NULL; job = firstJob()) {
+		removeJobById(job->job_id);
+	}
+	free(slots);
+	free(pid_index);
+	slots = NULL;
+	pid_index = NULL;
+	pid_index_size = 0;
+	pid_index_count = 0;
+	bitmapFree(&used_ids);
+	bitmapFree(&stopped_ids);
+	free(queue);
+	queue = NULL;
+	queue_cap = 0;
+
+	for(int i = 0; i < FINISHED_JOBS_MAX; i++) {
+		free(finished[i].command);
+	}
+	memset(finished, 0, sizeof(finished));
+	finished_next = 0;
+	finished_count = 0;
+}
+
+void setJobState(Job* job, JobState state) {
+	state_counts[job->state]--;
+	state_counts[state]++;
+	job->state = state;
+	if(state == STOPPED) {
+		bitmapSet(&stopped_ids, job->job_id);
+	} else {
+		bitmapClear(&stopped_ids, job->job_id);
+	}
+}
+
+Job* findJobById(int job_id) {
+	if(job_id < 0 || job_id >= tableCapacity()) {
+		return NULL;
+	}
+	return slots[job_id];
+}
+
+Job* findJobByPid(pid_t pid) {
+	PidEntry* entry = pidIndexFind(pid);
+	return entry ? entry->job : NULL;
+}
+
+Job* findMaxIdJobForFG(void) {
+	return findJobById(bitmapLast(&used_ids));
+}
+
+Job* findMaxIdJobForBG(void) {
+	return findJobById(bitmapLast(&stopped_ids));
+}
+
+Job* firstJob(void) {
+	return findJobById(bitmapNext(&used_ids, 0));
+}
+
+Job* nextJob(const Job* job) {
+	return findJobById(bitmapNext(&used_ids, job->job_id + 1));
+}
+
+Job* findJobFrom(int job_id) {
+	return findJobById(bitmapNext(&used_ids, job_id < 0 ? 0 : job_id));
+}
@@ -0,0 +1,163 @@
+#ifndef JOBS_H
+#define JOBS_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+
+//default soft limit on the number of jobs, see setJobsLimit()
+#define JOBS_NUM_MAX 100
+
+//number of finished jobs remembered for lastjobs
+#define FINISHED_JOBS_MAX 32
+
+/*=============================================================================
+* job table
+*
+* jobs live in a slot array indexed by job id. a two level bitmap tracks which
+* ids are in use (lowest free id, highest id) and which jobs are stopped
+* (highest stopped id), and a pid -> job hash index over every process of
+* every job serves the reaper, so every operation below is O(1) in practice
+* regardless of the number of jobs.
+=============================================================================*/
+struct ThreadTask;
+struct CpuSet;
+
+typedef enum {
+    BACKGROUND,
+    STOPPED,
+    QUEUED      //submitted, waits for a free running slot, has no process yet
+} JobState;
+
+typedef struct Job {
+    int job_id;
+    pid_t pid;         //process group of the job, the pid of its first process
+    char* command;
+    time_t start_time;
+    JobState state;
+    int alive;         //processes not reaped yet
+    int status;        //wait status of the last process once it is reaped
+    struct rusage usage; //what the reaped processes used, see addUsage()
+    struct ThreadTask* task; //set when a pool thread runs the job, see threadpool.h
+    struct CpuSet* cpus; //what placement or pin gave the job, see affinity.h
+    int priority;      //of a QUEUED job, higher starts first
+    unsigned long queue_seq; //submission order, breaks priority ties
+    int queue_slot;    //position in the queue heap, -1 unless QUEUED
+    int pids_num;
+    pid_t pids[];      //every process of the job (pipeline stages), 0 once reaped
+} Job;
+
+typedef struct {
+    int job_id;
+    pid_t pid;
+    char* command;
+    time_t start_time;
+    time_t end_time;
+    int status;
+    struct rusage usage;
+} FinishedJob;
+
+/*
+ * reads the soft limit from the SMASH_JOBS_MAX environment variable, if set.
+ * queued jobs do not count against it, they only need a slot once started
+ */
+void initJobs(void);
+void setJobsLimit(int limit);
+int getJobsLimit(void);
+int jobsCount(void);
+bool isJobsListFull(void);
+
+//jobs in the BACKGROUND state, what the running limit of the queue is about
+int runningJobsCount(void);
+int queuedJobsCount(void);
+
+/*
+ * queued jobs start while fewer than the running limit run. it is read from
+ * SMASH_RUNNING_MAX if set, and is the number of cpus otherwise
+ */
+void setRunningLimit(int limit);
+int getRunningLimit(void);
+
+/*
+ * returns the new job id, or -1 if the job list is full
+ */
+int addJob(pid_t pid, const char* command, JobState state);
+
+/*
+ * adds a job made of several processes in process group pgid, entries of
+ * pids that are 0 stand for processes that are already gone
+ */
+int addJobGroup(pid_t pgid, const pid_t* pids, int pids_num, const char* command, JobState state);
+
+/*
+ * adds a backgrounded builtin that runs on a pool thread. it has no process
+ * of its own, its pid is the shell's and it can neither be stopped nor signalled
+ */
+int addThreadJob(struct ThreadTask* task, const char* command);
+
+/*
+ * adds a QUEUED job for command, returns its id
+ */
+int addQueuedJob(const char* command, int priority);
+
+/*
+ * puts back a queued job that could not start, with the id, priority and
+ * place in the queue it had
+ */
+void requeueJob(int job_id, const char* command, int priority, unsigned long seq);
+
+//the queued job that starts next, NULL if none is queued or if called from
+//a forked child of the shell, the queue is the shell's alone
+Job* nextQueuedJob(void);
+
+/*
+ * the next job added gets job_id if it is free then, -1 to stop asking.
+ * keeps the id of a queued job once it starts
+ */
+void reserveJobId(int job_id);
+
+void removeJobById(int job_id);
+
+/*
+ * records the cpus job is pinned to and counts them as taken, NULL for none
+ */
+void setJobCpus(Job* job, const struct CpuSet* cpus);
+void clearJobs(void);
+void setJobState(Job* job, JobState state);
+
+/*
+ * marks pid of job as reaped with the status and usage wait4 gave for it,
+ * returns true once no process of the job is left
+ */
+bool jobProcessExited(Job* job, pid_t pid, int status, const struct rusage* usage);
+
+/*
+ * moves a job that is done to the finished jobs ring, dropping the oldest
+ */
+void finishJob(Job* job);
+
+/*
+ * sums cpu times and context switches, keeps the largest max rss
+ */
+void addUsage(struct rusage* total, const struct rusage* usage);
+
+Job* findJobById(int job_id);
+Job* findJobByPid(pid_t pid);
+Job* findMaxIdJobForFG(void);
+Job* findMaxIdJobForBG(void);
+
+//iteration in increasing job id order
+Job* firstJob(void);
+Job* nextJob(const Job* job);
+
+//the job with the lowest id that is >= job_id, NULL if there is none
+Job* findJobFrom(int job_id);
+
+//finished jobs, oldest first, NULL past the last one
+int finishedJobsCount(void);
+const FinishedJob* finishedJob(int i);
+
+#endif //JOBS_H
@@ -0,0 +1,123 @@
+//linereader.c
+#include "linereader.h"
+#include "commands.h"
+#include "signals.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+static LineReader* stdin_reader = NULL;
+static pid_t stdin_reader_owner = -1;
+
+/*
+ * blocks until stdin is readable, reaping children and answering CTRL+C and
+ * CTRL+Z whenever a signal wakes us up in the meantime, so finished jobs do
+ * not linger as zombies at the prompt. returns false if an interruptible
+ * reader was interrupted instead
+ */
+static bool waitForInput(LineReader* reader)
+{
+	struct pollfd fds[2] = {
+		{ .fd = reader->fd, .events = POLLIN },
+		{ .fd = signal_fd(), .events = POLLIN },
+	};
+
+	while(1) {
+		if(poll(fds, 2, -1) == -1) {
+			if(errno == EINTR) {
+				if(handle_pending_signals() && reader->interruptible) {
+					return false;
+				}
+				continue;
+			}
+			return true;
+		}
+		if(fds[1].revents & POLLIN) {
+			drain_signal_fd();
+			if(handle_pending_signals() && reader->interruptible) {
+				return false;
+			}
+			//a builtin reading stdin has workers of its own the reaper must not take
+			if(!reader->interruptible) {
+				cleanFinishedJobs();
+			}
+		}
+		if(fds[0].revents) {
+			return true;
+		}
+	}
+}
+
+static void growReader(LineReader* reader)
+{
+	reader->size *= 2;
+	reader->buf = realloc(reader->buf, reader->size);
+	if(!reader->buf) ERROR_EXIT("realloc");
+}
+
+static void fillReader(LineReader* reader)
+{
+	//compact once per buffer, not once per line
+	if(reader->start > 0) {
+		memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+	}
+
+	while(1) {
+		if(reader->interactive && !waitForInput(reader)) {
+			reader->interrupted = true;
+			return;
+		}
+		ssize_t n = my_system_call(SYS_READ, reader->fd, reader->buf + reader->end,
+			reader->size - reader->end);
+		if(n == -1 && errno == EINTR) {
+			if(handle_pending_signals() && reader->interruptible) {
+				reader->interrupted = true;
+				return;
+			}
+			continue;
+		}
+		if(n <= 0) {
+			reader->eof = true;
+		} else {
+			reader->end += n;
+		}
+		return;
+	}
+}
+
+const char* nextLine(LineReader* reader, size_t* len)
+{
+	while(1) {
+		char* line = reader->buf + reader->start;
+		size_t avail = reader->end - reader->start;
+		char* nl = memchr(line, '\n', avail);
+
+		if(nl || (avail > 0 && reader->eof)) {
+			*len = nl ? (size_t)(nl - line) : avail;
+			reader->start += nl ? *len + 1 : *len;
+			return line;
+		}
+		if(reader->eof || reader->interrupted) {
+			return NULL;
+		}
+		if(avail == reader->size) {
+			growReader(reader);
+		}
+		fillReader(reader);
+	}
+}
+
+void setShellStdinReader(LineReader* reader)
+{
+	stdin_reader = reader;
+	stdin_reader_owner = getpid();
+}
+
+LineReader* shellStdinReader(void)
+{
+	return getpid() == stdin_reader_owner ? stdin_reader : NULL;
+}
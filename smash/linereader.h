@@ -0,0 +1,52 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <stddef.h>
+
+//big enough that batch input costs one read per many lines, grows for longer ones
+#define INPUT_BUFFER_SIZE (64 * 1024)
+
+/*=============================================================================
+* line input
+*
+* a source of command lines: stdin, a script file or a -c string. mapped
+* scripts and -c strings are complete in buf from the start and are never
+* refilled, everything else is read from fd as needed into a malloc'd buf
+* that doubles whenever a single line does not fit.
+*
+* whatever reads stdin in the shell itself has to go through the reader the
+* shell takes its commands from, or the two steal buffered lines from each
+* other. builtins get it from shellStdinReader().
+=============================================================================*/
+typedef struct {
+	int fd;
+	bool interactive;   //wait for input alongside SIGCHLD
+	bool interruptible; //CTRL+C ends the lines for now, see nextLine()
+	bool interrupted;
+	char* buf;
+	size_t size;
+	size_t start;       //first byte not yet returned
+	size_t end;         //end of the valid bytes
+	bool eof;
+} LineReader;
+
+/*
+ * returns the next line (without the newline) and its length in len, the
+ * line is not NUL terminated and only valid until the next call. returns
+ * NULL once the input is exhausted, or when an interruptible reader is
+ * interrupted by CTRL+C while it waits, which sets interrupted
+ */
+const char* nextLine(LineReader* reader, size_t* len);
+
+/*
+ * the shell reads its commands from stdin through reader, NULL once it
+ * stops. only the process that set it gets it back, a forked child reads
+ * stdin on its own
+ */
+void setShellStdinReader(LineReader* reader);
+LineReader* shellStdinReader(void);
+
+#endif //LINEREADER_H
@@ -0,0 +1,185 @@
+//parser.c
+#include "parser.h"
+
+#include <string.h>
+
+#define INITIAL_TOKENS 16
+
+static bool isDelimiter(char c) {
+	return c == ' ' || c == '\t' || c == '\n';
+}
+
+//& runs in the background only at the end of a word, echo a&b is one word
+static bool isOperatorAmp(const char* p) {
+	return p[0] == '&' && (p[1] == '&' || p[1] == '\0' || isDelimiter(p[1]));
+}
+
+//scans one word starting at p into words, quotes are removed as they go
+static char* scanWord(char* p, Token* token, char** words) {
+	char* out = *words;
+	char quote = '\0';
+
+	token->type = TOKEN_WORD;
+	token->word = out;
+	while(*p) {
+		if(quote) {
+			if(*p == quote) {
+				quote = '\0';
+			} else {
+				*out++ = *p;
+			}
+			p++;
+			continue;
+		}
+		if(*p == '\'' || *p == '\"') {
+			quote = *p++;
+			token->quoted = true;
+			continue;
+		}
+		if(isDelimiter(*p) || isOperatorAmp(p) || (*p == '|' && p[1] != '|')) {
+			break;
+		}
+		if(*p == '|') {
+			//"||" is not an operator of ours, it stays part of the word
+			*out++ = *p++;
+		}
+		*out++ = *p++;
+	}
+	*out++ = '\0';
+	*words = out;
+	return quote ? NULL : p;
+}
+
+ParsingError lexLine(Arena* arena, char* line, TokenList* list) {
+
+	//words are never longer than the line, and each one ends at a character we drop
+	char* words = arenaAlloc(arena, strlen(line) + 1);
+	int capacity = INITIAL_TOKENS;
+	Token* tokens = arenaAlloc(arena, capacity * sizeof(Token));
+	int tokens_num = 0;
+
+	char* p = line;
+	while(1) {
+		while(isDelimiter(*p)) {
+			p++;
+		}
+		if(!*p) {
+			break;
+		}
+		if(tokens_num == capacity) {
+			Token* grown = arenaAlloc(arena, 2 * capacity * sizeof(Token));
+			memcpy(grown, tokens, capacity * sizeof(Token));
+			tokens = grown;
+			capacity *= 2;
+		}
+
+		Token* token = &tokens[tokens_num++];
+		token->start = p;
+		token->quoted = false;
+		token->word = NULL;
+		if(p[0] == '&' && p[1] == '&') {
+			token->type = TOKEN_AND;
+			p += 2;
+		} else if(isOperatorAmp(p)) {
+			token->type = TOKEN_AMP;
+			p++;
+		} else if(*p == '|' && p[1] != '|') {
+			token->type = TOKEN_PIPE;
+			p++;
+		} else if(!(p = scanWord(p, token, &words))) {
+			return INVALID_COMMAND;
+		}
+		token->end = p;
+	}
+
+	list->tokens = tokens;
+	list->tokens_num = tokens_num;
+	return VALID_COMMAND;
+}
+
+//parses the stage starting at tokens[*i], a run of words
+static bool parseStage(Arena* arena, const TokenList* list, int* i, Stage* stage) {
+	int words = 0;
+	while(*i + words < list->tokens_num && list->tokens[*i + words].type == TOKEN_WORD) {
+		words++;
+	}
+	if(words == 0) {
+		return false;
+	}
+
+	stage->argc = words;
+	stage->argv = arenaAlloc(arena, (words + 1) * sizeof(char*));
+	for(int k = 0; k < words; k++) {
+		stage->argv[k] = list->tokens[*i + k].word;
+	}
+	stage->argv[words] = NULL;
+	*i += words;
+	return true;
+}
+
+//parses the command starting at tokens[*i], up to the next && or the end
+static bool parseCommand(Arena* arena, const TokenList* list, int* i, Command* command) {
+	const Token* tokens = list->tokens;
+	const int first = *i;
+
+	command->stages_num = 1;
+	for(int j = first; j < list->tokens_num && tokens[j].type != TOKEN_AND; j++) {
+		if(tokens[j].type == TOKEN_PIPE) {
+			command->stages_num++;
+		}
+	}
+	command->stages = arenaAlloc(arena, command->stages_num * sizeof(Stage));
+	command->background = false;
+
+	for(int s = 0; s < command->stages_num; s++) {
+		if(!parseStage(arena, list, i, &command->stages[s])) {
+			return false;
+		}
+		if(*i < list->tokens_num && tokens[*i].type == TOKEN_PIPE) {
+			(*i)++;
+		} else if(*i < list->tokens_num && tokens[*i].type == TOKEN_AMP) {
+			//& only ends the last stage, right before && or the end of the line
+			command->background = true;
+			(*i)++;
+			if(s != command->stages_num - 1 || (*i < list->tokens_num && tokens[*i].type != TOKEN_AND)) {
+				return false;
+			}
+		}
+	}
+
+	command->text = tokens[first].start;
+	return true;
+}
+
+ParsingError parseTokens(Arena* arena, const TokenList* list, CommandList* commands) {
+
+	if(list->tokens_num == 0) {
+		return INVALID_COMMAND;
+	}
+
+	int commands_num = 1;
+	for(int i = 0; i < list->tokens_num; i++) {
+		if(list->tokens[i].type == TOKEN_AND) {
+			commands_num++;
+		}
+	}
+	Command* parsed = arenaAlloc(arena, commands_num * sizeof(Command));
+	char** ends = arenaAlloc(arena, commands_num * sizeof(char*));
+
+	int i = 0;
+	for(int c = 0; c < commands_num; c++) {
+		if(!parseCommand(arena, list, &i, &parsed[c])) {
+			return INVALID_COMMAND;
+		}
+		ends[c] = list->tokens[i - 1].end;
+		i++; //the && after it
+	}
+
+	//only now, an end may be the first character of the token after it
+	for(int c = 0; c < commands_num; c++) {
+		*ends[c] = '\0';
+	}
+	commands->commands = parsed;
+	commands->commands_num = commands_num;
+	return VALID_COMMAND;
+}
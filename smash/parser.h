@@ -0,0 +1,72 @@
+#ifndef PARSER_H
+#define PARSER_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+
+#include "arena.h"
+
+/*=============================================================================
+* lexer and parser
+*
+* a command line is scanned once into tokens. words are unquoted into a
+* single buffer as they are scanned, and every token remembers the span of
+* the line it came from. the parser then groups the tokens into commands
+* joined by &&, each a pipeline of stages, without looking at the line again.
+* everything is allocated from the arena the caller passes in.
+=============================================================================*/
+typedef enum {
+	INVALID_COMMAND = 0,
+	VALID_COMMAND,
+} ParsingError;
+
+typedef enum {
+	TOKEN_WORD,
+	TOKEN_PIPE, //|
+	TOKEN_AND,  //&&
+	TOKEN_AMP   //&
+} TokenType;
+
+typedef struct {
+	TokenType type;
+	bool quoted;       //a word with quotes in it is never an alias
+	char* word;        //unquoted text of a TOKEN_WORD
+	char* start;       //span of the token in the line
+	char* end;
+} Token;
+
+typedef struct {
+	Token* tokens;
+	int tokens_num;
+} TokenList;
+
+typedef struct {
+	char** argv;       //NULL terminated
+	int argc;
+} Stage;
+
+typedef struct {
+	const char* text;  //the command as typed, for jobs and error messages
+	Stage* stages;     //stages of the pipeline, at least one
+	int stages_num;
+	bool background;
+} Command;
+
+typedef struct {
+	Command* commands; //joined by &&
+	int commands_num;
+} CommandList;
+
+/*
+ * splits line into tokens, fails on an unterminated quote
+ */
+ParsingError lexLine(Arena* arena, char* line, TokenList* list);
+
+/*
+ * builds the commands of list. on success the text of every command is
+ * NUL terminated in place, so the line must not be lexed again afterwards
+ */
+ParsingError parseTokens(Arena* arena, const TokenList* list, CommandList* commands);
+
+#endif //PARSER_H
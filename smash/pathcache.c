@@ -0,0 +1,241 @@
+//pathcache.c
+#define _GNU_SOURCE
+#include "pathcache.h"
+#include "commands.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define INITIAL_TABLE_SIZE 64
+
+typedef struct {
+	char* name; //NULL marks an empty slot
+	char* path;
+	int dir;    //index into path_dirs the command was found in
+	unsigned hits;
+} PathEntry;
+
+typedef struct {
+	char* dir;
+	struct timespec mtime;
+	bool has_mtime;
+} PathDir;
+
+static char* path_env = NULL; //the PATH the cache was built for
+static PathDir* path_dirs = NULL;
+static int path_dirs_num = 0;
+
+static PathEntry* table = NULL; //open addressing, linear probing
+static size_t table_size = 0;
+static size_t entries_num = 0;
+
+static size_t hashName(const char* name) {
+	uint32_t h = 2166136261u;
+	for(const char* p = name; *p; p++) {
+		h = (h ^ (unsigned char)*p) * 16777619u;
+	}
+	return h & (table_size - 1);
+}
+
+static char* copyString(const char* str) {
+	size_t len = strlen(str);
+	char* copy = MALLOC_VALIDATED(char, len + 1);
+	memcpy(copy, str, len + 1);
+	return copy;
+}
+
+static void flushEntries(void) {
+	for(size_t i = 0; i < table_size; i++) {
+		free(table[i].name);
+		free(table[i].path);
+	}
+	memset(table, 0, table_size * sizeof(PathEntry));
+	entries_num = 0;
+	for(int i = 0; i < path_dirs_num; i++) {
+		path_dirs[i].has_mtime = false;
+	}
+}
+
+static void freeDirs(void) {
+	for(int i = 0; i < path_dirs_num; i++) {
+		free(path_dirs[i].dir);
+	}
+	free(path_dirs);
+	free(path_env);
+	path_dirs = NULL;
+	path_dirs_num = 0;
+	path_env = NULL;
+}
+
+//drops everything if PATH is not the one the cache was built for
+static void syncPathEnv(void) {
+	const char* env = getenv("PATH");
+	if(!env) {
+		env = "/bin:/usr/bin"; //what execvp searches when PATH is unset
+	}
+	if(path_env && strcmp(path_env, env) == 0) {
+		return;
+	}
+
+	if(table) {
+		flushEntries();
+	}
+	freeDirs();
+	path_env = copyString(env);
+
+	int num = 1;
+	for(const char* p = env; *p; p++) {
+		if(*p == ':') num++;
+	}
+	path_dirs = MALLOC_VALIDATED(PathDir, num * sizeof(PathDir));
+
+	const char* start = env;
+	for(int i = 0; i < num; i++) {
+		const char* end = strchr(start, ':');
+		size_t len = end ? (size_t)(end - start) : strlen(start);
+		path_dirs[i].dir = MALLOC_VALIDATED(char, len + 1);
+		memcpy(path_dirs[i].dir, start, len);
+		path_dirs[i].dir[len] = '\0';
+		path_dirs[i].has_mtime = false;
+		start = end ? end + 1 : start + len;
+	}
+	path_dirs_num = num;
+}
+
+//records the directory mtime the first time, afterwards reports whether it changed
+static bool dirUnchanged(PathDir* dir) {
+	struct stat st;
+	if(stat(dir->dir, &st) != 0) {
+		st.st_mtim.tv_sec = 0;
+		st.st_mtim.tv_nsec = 0;
+	}
+	if(!dir->has_mtime) {
+		dir->mtime = st.st_mtim;
+		dir->has_mtime = true;
+		return true;
+	}
+	return dir->mtime.tv_sec == st.st_mtim.tv_sec && dir->mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static bool isExecutable(const char* path) {
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+static PathEntry* findSlot(const char* name) {
+	size_t i = hashName(name);
+	while(table[i].name && strcmp(table[i].name, name) != 0) {
+		i = (i + 1) & (table_size - 1);
+	}
+	return &table[i];
+}
+
+static void growTable(void) {
+	PathEntry* old = table;
+	size_t old_size = table_size;
+
+	table_size = table_size ? table_size * 2 : INITIAL_TABLE_SIZE;
+	table = calloc(table_size, sizeof(PathEntry));
+	if(!table) ERROR_EXIT("calloc");
+
+	for(size_t i = 0; i < old_size; i++) {
+		if(old[i].name) {
+			*findSlot(old[i].name) = old[i];
+		}
+	}
+	free(old);
+}
+
+//searches PATH the way execvp does, caching absolute hits
+static const char* resolve(const char* cmd) {
+
+	size_t cmd_len = strlen(cmd);
+	for(int i = 0; i < path_dirs_num; i++) {
+		PathDir* dir = &path_dirs[i];
+		size_t dir_len = strlen(dir->dir);
+
+		//record the mtime before looking, a change in between invalidates us later
+		dirUnchanged(dir);
+
+		char* candidate = MALLOC_VALIDATED(char, dir_len + cmd_len + 2);
+		memcpy(candidate, dir->dir, dir_len);
+		candidate[dir_len] = '/';
+		memcpy(candidate + dir_len + 1, cmd, cmd_len + 1);
+
+		if(!isExecutable(candidate)) {
+			free(candidate);
+			continue;
+		}
+		if(dir->dir[0] != '/') {
+			//relative to the working directory, not worth caching
+			free(candidate);
+			return NULL;
+		}
+
+		if(2 * (entries_num + 1) > table_size) {
+			growTable();
+		}
+		PathEntry* entry = findSlot(cmd);
+		entry->name = copyString(cmd);
+		entry->path = candidate;
+		entry->dir = i;
+		entry->hits = 0;
+		entries_num++;
+		return candidate;
+	}
+	return NULL;
+}
+
+const char* lookupCommandPath(const char* cmd) {
+
+	if(cmd[0] == '\0' || strchr(cmd, '/')) {
+		return NULL;
+	}
+	syncPathEnv();
+	if(!table) {
+		growTable();
+	}
+
+	PathEntry* entry = findSlot(cmd);
+	if(entry->name) {
+		bool valid = true;
+		for(int i = 0; i <= entry->dir && valid; i++) {
+			valid = dirUnchanged(&path_dirs[i]);
+		}
+		if(valid) {
+			entry->hits++;
+			return entry->path;
+		}
+		flushEntries();
+	}
+	return resolve(cmd);
+}
+
+bool hashCommand(const char* cmd) {
+	return lookupCommandPath(cmd) != NULL;
+}
+
+void clearPathCache(void) {
+	if(table) {
+		flushEntries();
+	}
+	free(table);
+	table = NULL;
+	table_size = 0;
+	freeDirs();
+}
+
+void printPathCache(void) {
+	if(entries_num == 0) {
+		printf("hash table empty\n");
+		return;
+	}
+	printf("hits\tcommand\n");
+	for(size_t i = 0; i < table_size; i++) {
+		if(table[i].name) {
+			printf("%4u\t%s\n", table[i].hits, table[i].path);
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+
+/*=============================================================================
+* executable path cache
+*
+* remembers where in PATH each external command was found, so a spawn can
+* exec the absolute path instead of having execvp retry every PATH directory.
+* the whole cache is dropped when PATH changes, or when the modification time
+* of a PATH directory at or before the one an entry came from changes (a new
+* binary could shadow it, or the cached one could be gone).
+=============================================================================*/
+
+/*
+ * returns the absolute path for cmd, resolving and caching it on a miss.
+ * returns NULL when cmd contains a '/', is not found, or was found in a
+ * relative PATH entry; the caller then falls back to a plain execvp.
+ */
+const char* lookupCommandPath(const char* cmd);
+
+/*
+ * resolves and caches cmd, returns false if it is not in PATH
+ */
+bool hashCommand(const char* cmd);
+void clearPathCache(void);
+void printPathCache(void);
+
+#endif //PATHCACHE_H
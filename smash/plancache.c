@@ -0,0 +1,142 @@
+//plancache.c
+#include "plancache.h"
+#include "commands.h"
+
+#include <string.h>
+
+#define TABLE_SIZE (2 * PLAN_CACHE_SIZE) //a power of two, kept at most half full
+
+static Plan* table[TABLE_SIZE]; //open addressing, linear probing
+static Plan* lru_first = NULL;
+static Plan* lru_last = NULL;
+static int plans_num = 0;
+static unsigned long plans_alias_version = 0;
+
+static uint64_t hashLine(const char* line, size_t* len) {
+	uint64_t h = 14695981039346656037ULL;
+	const char* p = line;
+	for(; *p; p++) {
+		h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+	}
+	*len = p - line;
+	return h;
+}
+
+static size_t homeSlot(uint64_t hash) {
+	return hash & (TABLE_SIZE - 1);
+}
+
+static Plan** lookupSlot(const char* line, size_t len, uint64_t hash) {
+	size_t i = homeSlot(hash);
+	while(table[i]) {
+		Plan* plan = table[i];
+		if(plan->hash == hash && plan->key_len == len && memcmp(plan->key, line, len) == 0) {
+			return &table[i];
+		}
+		i = (i + 1) & (TABLE_SIZE - 1);
+	}
+	return &table[i];
+}
+
+static void freePlan(Plan* plan) {
+	arenaFree(&plan->storage);
+	free(plan);
+}
+
+static void unlinkPlan(Plan* plan) {
+	if(plan->prev) plan->prev->next = plan->next;
+	else lru_first = plan->next;
+	if(plan->next) plan->next->prev = plan->prev;
+	else lru_last = plan->prev;
+	plan->prev = plan->next = NULL;
+}
+
+static void pushFront(Plan* plan) {
+	plan->next = lru_first;
+	if(lru_first) lru_first->prev = plan;
+	else lru_last = plan;
+	lru_first = plan;
+}
+
+static void evictPlan(Plan* plan) {
+
+	//backward shift deletion, no tombstones needed
+	size_t i = lookupSlot(plan->key, plan->key_len, plan->hash) - table;
+	size_t j = i;
+	table[i] = NULL;
+	while(1) {
+		j = (j + 1) & (TABLE_SIZE - 1);
+		if(!table[j]) {
+			break;
+		}
+		size_t home = homeSlot(table[j]->hash);
+		bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+		if(movable) {
+			table[i] = table[j];
+			table[j] = NULL;
+			i = j;
+		}
+	}
+
+	unlinkPlan(plan);
+	plans_num--;
+	plan->cached = false;
+	if(plan->refs == 0) {
+		freePlan(plan);
+	}
+}
+
+Plan* findPlan(const char* line) {
+
+	//every plan was expanded with the aliases of its time
+	if(plans_alias_version != aliasVersion()) {
+		clearPlanCache();
+		plans_alias_version = aliasVersion();
+	}
+
+	size_t len;
+	uint64_t hash = hashLine(line, &len);
+	Plan* plan = *lookupSlot(line, len, hash);
+	if(!plan) {
+		return NULL;
+	}
+	if(plan != lru_first) {
+		unlinkPlan(plan);
+		pushFront(plan);
+	}
+	plan->refs++;
+	return plan;
+}
+
+Plan* newPlan(const char* line) {
+	Plan* plan = MALLOC_VALIDATED(Plan, sizeof(Plan));
+	memset(plan, 0, sizeof(Plan));
+	plan->hash = hashLine(line, &plan->key_len);
+	plan->key = arenaStrndup(&plan->storage, line, plan->key_len);
+	plan->line = arenaStrndup(&plan->storage, line, plan->key_len);
+	plan->refs = 1;
+	return plan;
+}
+
+void cachePlan(Plan* plan) {
+	if(plans_num == PLAN_CACHE_SIZE) {
+		evictPlan(lru_last);
+	}
+	*lookupSlot(plan->key, plan->key_len, plan->hash) = plan;
+	pushFront(plan);
+	plan->cached = true;
+	plans_num++;
+}
+
+void releasePlan(Plan* plan) {
+	plan->refs--;
+	if(plan->refs == 0 && !plan->cached) {
+		freePlan(plan);
+	}
+}
+
+void clearPlanCache(void) {
+	while(lru_first) {
+		evictPlan(lru_first);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef PLANCACHE_H
+#define PLANCACHE_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "parser.h"
+
+//number of parsed lines kept, the least recently used one goes first
+#define PLAN_CACHE_SIZE 64
+
+/*=============================================================================
+* parsed command cache
+*
+* a plan is a command line after lexing, alias expansion and parsing. plans
+* are kept in a hash table keyed by the raw line and ordered by last use, so
+* a line that runs again skips straight to execution. alias expansion is
+* baked into the plans, so they are all dropped once the alias table changes.
+* a plan in use is reference counted and outlives its eviction until released.
+=============================================================================*/
+typedef struct Plan {
+	CommandList commands;
+	char* line;         //copy of the line to parse, the parser cuts it up
+	Arena storage;      //the plan and everything it points to
+	char* key;          //the line as given
+	size_t key_len;
+	uint64_t hash;
+	int refs;
+	bool cached;
+	struct Plan* prev;  //use order, most recent first
+	struct Plan* next;
+} Plan;
+
+/*
+ * returns the cached plan of line, or NULL. the plan is held until released
+ */
+Plan* findPlan(const char* line);
+
+/*
+ * returns a new plan for line with no commands yet, held by the caller
+ */
+Plan* newPlan(const char* line);
+
+/*
+ * adds a parsed plan to the cache, evicting the least recently used one
+ */
+void cachePlan(Plan* plan);
+void releasePlan(Plan* plan);
+void clearPlanCache(void);
+
+#endif //PLANCACHE_H
@@ -0,0 +1,183 @@
+//schedpolicy.c
+#define _GNU_SOURCE
+#include "schedpolicy.h"
+#include "commands.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+//from linux/ioprio.h, which not every libc ships
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_PRIO_VALUE(class, level) (((class) << IOPRIO_CLASS_SHIFT) | (level))
+#define IOPRIO_PRIO_CLASS(value) ((value) >> IOPRIO_CLASS_SHIFT)
+#define IOPRIO_PRIO_DATA(value) ((value) & ((1 << IOPRIO_CLASS_SHIFT) - 1))
+#define IOPRIO_WHO_PROCESS 1
+
+static const char* sched_class_names[] = {
+	[SCHED_CLASS_NORMAL] = "normal",
+	[SCHED_CLASS_BATCH] = "batch",
+	[SCHED_CLASS_IDLE] = "idle",
+};
+
+static const int sched_class_policies[] = {
+	[SCHED_CLASS_NORMAL] = SCHED_OTHER,
+	[SCHED_CLASS_BATCH] = SCHED_BATCH,
+	[SCHED_CLASS_IDLE] = SCHED_IDLE,
+};
+
+static const char* io_class_names[] = {
+	[IO_CLASS_NONE] = "none",
+	[IO_CLASS_RT] = "rt",
+	[IO_CLASS_BE] = "be",
+	[IO_CLASS_IDLE] = "idle",
+};
+
+#define SCHED_CLASSES_NUM ((int)(sizeof(sched_class_names) / sizeof(sched_class_names[0])))
+#define IO_CLASSES_NUM ((int)(sizeof(io_class_names) / sizeof(io_class_names[0])))
+
+static SchedPolicy shell_policy;
+static SchedPolicy policies[2];
+
+void initSchedPolicy(void) {
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, 0);
+	shell_policy.nice = errno ? 0 : nice;
+
+	switch(sched_getscheduler(0)) {
+		case SCHED_BATCH:
+			shell_policy.sched = SCHED_CLASS_BATCH;
+			break;
+		case SCHED_IDLE:
+			shell_policy.sched = SCHED_CLASS_IDLE;
+			break;
+		default:
+			shell_policy.sched = SCHED_CLASS_NORMAL;
+			break;
+	}
+
+	long ioprio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+	shell_policy.io_class = ioprio < 0 ? IO_CLASS_NONE : (int)IOPRIO_PRIO_CLASS(ioprio);
+	shell_policy.io_level = ioprio < 0 ? 4 : (int)IOPRIO_PRIO_DATA(ioprio);
+
+	policies[SCHED_FOREGROUND] = shell_policy;
+
+	SchedPolicy* bg = &policies[SCHED_BACKGROUND];
+	bg->nice = shell_policy.nice + SCHED_BACKGROUND_NICE > 19 ? 19 : shell_policy.nice + SCHED_BACKGROUND_NICE;
+	bg->sched = shell_policy.sched == SCHED_CLASS_IDLE ? SCHED_CLASS_IDLE : SCHED_CLASS_BATCH;
+	bg->io_class = shell_policy.io_class == IO_CLASS_IDLE ? IO_CLASS_IDLE : IO_CLASS_BE;
+	bg->io_level = SCHED_BACKGROUND_IO_LEVEL;
+}
+
+SchedPolicy* schedPolicy(SchedRole role) {
+	return &policies[role];
+}
+
+const SchedPolicy* spawnSchedPolicy(SchedRole role) {
+	const SchedPolicy* policy = &policies[role];
+	if(memcmp(policy, &shell_policy, sizeof(SchedPolicy)) == 0) {
+		return NULL;
+	}
+	return policy;
+}
+
+bool applySchedPolicy(pid_t tid, const SchedPolicy* policy) {
+	bool ok = true;
+
+	//the class first, leaving SCHED_IDLE may depend on the nice value
+	if(policy->sched != SCHED_KEEP) {
+		struct sched_param param = { .sched_priority = 0 };
+		if(sched_setscheduler(tid, sched_class_policies[policy->sched], &param) == -1) {
+			ok = false;
+		}
+	}
+	if(policy->nice != SCHED_KEEP && setpriority(PRIO_PROCESS, tid, policy->nice) == -1) {
+		ok = false;
+	}
+	if(policy->io_class != SCHED_KEEP) {
+		int level = policy->io_level != SCHED_KEEP ? policy->io_level : 4;
+		if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_PRIO_VALUE(policy->io_class, level)) == -1) {
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+bool forEachThread(pid_t pid, ThreadAction action, const void* arg) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+	DIR* dir = opendir(path);
+	if(!dir) {
+		//no /proc, the main thread is all we can reach
+		return action(pid, arg);
+	}
+
+	bool ok = true;
+	int saved_errno = 0;
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL) {
+		if(entry->d_name[0] == '.') {
+			continue;
+		}
+		if(!action((pid_t)atoi(entry->d_name), arg) && errno != ESRCH) {
+			ok = false;
+			saved_errno = errno;
+		}
+	}
+	closedir(dir);
+	errno = saved_errno;
+	return ok;
+}
+
+static bool applyToThread(pid_t tid, const void* arg) {
+	return applySchedPolicy(tid, arg);
+}
+
+bool applySchedPolicyToProcess(pid_t pid, const SchedPolicy* policy) {
+	return forEachThread(pid, applyToThread, policy);
+}
+
+int schedClassPolicy(int sched) {
+	return sched_class_policies[sched];
+}
+
+bool parseSchedClass(const char* name, int* sched) {
+	for(int i = 0; i < SCHED_CLASSES_NUM; i++) {
+		if(strcmp(name, sched_class_names[i]) == 0) {
+			*sched = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool parseIoClass(const char* spec, int* io_class, int* io_level) {
+	const char* colon = strchr(spec, ':');
+	size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+
+	for(int i = 0; i < IO_CLASSES_NUM; i++) {
+		if(strlen(io_class_names[i]) == len && strncmp(spec, io_class_names[i], len) == 0) {
+			if(colon) {
+				char* end;
+				long level = strtol(colon + 1, &end, 10);
+				if(!colon[1] || *end || level < 0 || level > 7) {
+					return false;
+				}
+				*io_level = (int)level;
+			}
+			*io_class = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void printSchedPolicy(const SchedPolicy* policy) {
+	printf("nice %d class %s io %s:%d", policy->nice, sched_class_names[policy->sched],
+		io_class_names[policy->io_class], policy->io_level);
+}
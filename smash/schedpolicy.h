@@ -0,0 +1,101 @@
+#ifndef SCHEDPOLICY_H
+#define SCHEDPOLICY_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <limits.h>
+#include <sys/types.h>
+
+//nice added on top of the shell's own for background jobs by default
+#define SCHED_BACKGROUND_NICE 10
+#define SCHED_BACKGROUND_IO_LEVEL 7
+
+//marks a field of a SchedPolicy that is left as it is
+#define SCHED_KEEP INT_MIN
+
+/*=============================================================================
+* scheduling policies
+*
+* every job runs with the policy of its role: the cpu nice value, the
+* scheduling class and the i/o priority class and level. foreground jobs get
+* what the shell itself runs with unless told otherwise, background jobs are
+* niced, SCHED_BATCH and best effort i/o at the lowest level, so a crowd of
+* them does not stall what the user is waiting for. jobs switch policy with
+* their role when moved by bg and fg.
+=============================================================================*/
+typedef enum {
+	SCHED_CLASS_NORMAL,  //SCHED_OTHER
+	SCHED_CLASS_BATCH,
+	SCHED_CLASS_IDLE
+} SchedClass;
+
+//the ioprio classes, in kernel order
+typedef enum {
+	IO_CLASS_NONE,  //follows the cpu nice value
+	IO_CLASS_RT,
+	IO_CLASS_BE,
+	IO_CLASS_IDLE
+} IoClass;
+
+typedef struct {
+	int nice;      //-20..19
+	int sched;     //a SchedClass
+	int io_class;  //an IoClass
+	int io_level;  //0..7, lower is more
+} SchedPolicy;
+
+#define SCHED_POLICY_KEEP { SCHED_KEEP, SCHED_KEEP, SCHED_KEEP, SCHED_KEEP }
+
+typedef enum {
+	SCHED_FOREGROUND,
+	SCHED_BACKGROUND
+} SchedRole;
+
+/*
+ * takes the foreground defaults from the shell's own settings
+ */
+void initSchedPolicy(void);
+
+SchedPolicy* schedPolicy(SchedRole role);
+
+/*
+ * the policy a new process of role has to be given, NULL if it is what the
+ * shell runs with anyway and inheriting it is enough
+ */
+const SchedPolicy* spawnSchedPolicy(SchedRole role);
+
+/*
+ * applies the fields of policy that are not SCHED_KEEP to a single thread,
+ * 0 for the calling one. async-signal-safe, so children may call it before
+ * exec. returns false if any of them failed, errno tells why
+ */
+bool applySchedPolicy(pid_t tid, const SchedPolicy* policy);
+
+/*
+ * same for every thread of process pid
+ */
+bool applySchedPolicyToProcess(pid_t pid, const SchedPolicy* policy);
+
+typedef bool (*ThreadAction)(pid_t tid, const void* arg);
+
+/*
+ * runs action on every thread of process pid, found in /proc, or on pid alone
+ * without /proc. threads that exit meanwhile are not failures. returns false
+ * if action failed on any other, errno tells why
+ */
+bool forEachThread(pid_t pid, ThreadAction action, const void* arg);
+
+//the kernel policy of a SchedClass, SCHED_OTHER and so on
+int schedClassPolicy(int sched);
+
+bool parseSchedClass(const char* name, int* sched);
+
+/*
+ * class or class:level, e.g. be:7
+ */
+bool parseIoClass(const char* spec, int* io_class, int* io_level);
+
+void printSchedPolicy(const SchedPolicy* policy);
+
+#endif //SCHEDPOLICY_H
@@ -1,45 +1,126 @@
-// signals.c
-#include "signals.h"
-#include <signal.h>
-#include <stdio.h>
-#include "my_system_call.h"
-#include "commands.h"
-
-static void sigint_handler(int sig) {
-    (void)sig;
-
-    my_system_call(SYS_SIGNAL, SIGINT, sigint_handler);
-
-    printf("smash: caught CTRL+C\n");
-
-    if (foreground_pid > 0) {
-        if (my_system_call(SYS_KILL, foreground_pid, SIGKILL) == -1) {
-            perrorSmash("kill", "SIGKILL failed");
-            return;
-        }
-
-        printf("smash: process %d was killed\n", foreground_pid);
-    }
-}
-
-static void sigtstp_handler(int sig) {
-    (void)sig;
-
-    my_system_call(SYS_SIGNAL, SIGTSTP, sigtstp_handler);
-
-    printf("smash: caught CTRL+Z\n");
-
-    if (foreground_pid > 0) {
-        if (my_system_call(SYS_KILL, foreground_pid, SIGSTOP) == -1) {
-            perrorSmash("kill", "SIGSTOP failed");
-            return;
-        }
-
-        printf("smash: process %d was stopped\n", foreground_pid);
-    }
-}
-
-void setup_signal_handlers(void) {
-    my_system_call(SYS_SIGNAL, SIGINT, sigint_handler);
-    my_system_call(SYS_SIGNAL, SIGTSTP, sigtstp_handler);
-}
\ No newline at end of file
+// signals.c
+#define _GNU_SOURCE
+#include "signals.h"
+#include <signal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "commands.h"
+
+static int signal_pipe[2] = {-1, -1};
+static volatile sig_atomic_t sigchld_pending = 0;
+
+//only the handlers write these, the main loop keeps how many it has handled
+static volatile sig_atomic_t sigint_count = 0;
+static volatile sig_atomic_t sigtstp_count = 0;
+static sig_atomic_t sigint_handled = 0;
+static sig_atomic_t sigtstp_handled = 0;
+
+//the real call, stats are not async-signal-safe
+void wake_main_loop(void) {
+    (my_system_call)(SYS_WRITE, signal_pipe[1], "s", 1);
+}
+
+static void sigchld_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+
+    sigchld_pending = 1;
+    wake_main_loop();
+
+    errno = saved_errno;
+}
+
+static void sigint_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+
+    sigint_count++;
+    wake_main_loop();
+
+    errno = saved_errno;
+}
+
+static void sigtstp_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+
+    sigtstp_count++;
+    wake_main_loop();
+
+    errno = saved_errno;
+}
+
+static void install_handler(int sig, void (*handler)(int), int flags) {
+    struct sigaction sa;
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = flags;
+    if (sigaction(sig, &sa, NULL) == -1) {
+        perrorSmash("sigaction", "sigaction failed");
+    }
+}
+
+static void signal_foreground(int sig, const char* name, const char* done) {
+    if (foreground_pid <= 0) {
+        return;
+    }
+    if (my_system_call(SYS_KILL, -foreground_pid, sig) == -1) {
+        perrorSmash("kill", name);
+        return;
+    }
+    printf("smash: process %d was %s\n", foreground_pid, done);
+}
+
+bool handle_pending_signals(void) {
+    const bool interrupted = sigint_handled != sigint_count;
+    while (sigint_handled != sigint_count) {
+        sigint_handled++;
+        printf("smash: caught CTRL+C\n");
+        signal_foreground(SIGKILL, "SIGKILL failed", "killed");
+    }
+    while (sigtstp_handled != sigtstp_count) {
+        sigtstp_handled++;
+        printf("smash: caught CTRL+Z\n");
+        signal_foreground(SIGSTOP, "SIGSTOP failed", "stopped");
+    }
+    fflush(stdout);
+    return interrupted;
+}
+
+int signal_fd(void) {
+    return signal_pipe[0];
+}
+
+void drain_signal_fd(void) {
+    //a signal arriving after this writes a new byte, so no wakeup is lost
+    char buf[64];
+    while (my_system_call(SYS_READ, signal_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+bool consume_sigchld(void) {
+    if (!sigchld_pending) {
+        return false;
+    }
+    sigchld_pending = 0;
+    return true;
+}
+
+void setup_signal_handlers(void) {
+    if (my_system_call(SYS_PIPE, signal_pipe) == -1) {
+        perrorSmash("pipe", "pipe failed");
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(signal_pipe[i], F_SETFL, fcntl(signal_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    //installed once. SIGCHLD restarts blocking calls, CTRL+C and CTRL+Z cut
+    //them short with EINTR so whoever is blocked handles them right away
+    install_handler(SIGCHLD, sigchld_handler, SA_RESTART);
+    install_handler(SIGINT, sigint_handler, 0);
+    install_handler(SIGTSTP, sigtstp_handler, 0);
+}
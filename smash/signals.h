@@ -1,25 +1,51 @@
-#ifndef SIGNALS_H
-#define SIGNALS_H
-
-/*=============================================================================
-* includes, defines, usings
-=============================================================================*/
-
-#include <sys/types.h>
-
-#define CMD_LENGTH_MAX 120
-
-extern pid_t foreground_pid;
-extern char foreground_cmd[CMD_LENGTH_MAX];
-
-
-/*=============================================================================
-* global functions
-=============================================================================*/
-void setup_signal_handlers(void);
-
-
-
-
-#endif
-
+#ifndef SIGNALS_H
+#define SIGNALS_H
+
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+extern pid_t foreground_pid;
+extern const char* foreground_cmd;
+
+
+/*=============================================================================
+* global functions
+=============================================================================*/
+void setup_signal_handlers(void);
+
+/*
+ * signals are turned into events: the handlers only count them and write a
+ * byte to a self-pipe, so the main loop can poll the read end next to stdin
+ * and act on them as soon as they arrive. whoever polls the pipe drains it
+ * before looking at what is pending.
+ */
+int signal_fd(void);
+void drain_signal_fd(void);
+
+/*
+ * makes signal_fd() readable, async-signal-safe and callable from any thread
+ */
+void wake_main_loop(void);
+
+/*
+ * returns true once per batch of SIGCHLD, the caller reaps the children
+ */
+bool consume_sigchld(void);
+
+/*
+ * does what CTRL+C and CTRL+Z caught since the last call ask for: kills or
+ * stops the foreground process group and reports it. called from the main
+ * loop, and by anything that blocks when its wait is cut short by EINTR.
+ * returns true if there was a CTRL+C among them
+ */
+bool handle_pending_signals(void);
+
+
+
+
+#endif
+
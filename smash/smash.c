@@ -1,15 +1,27 @@
 //smash.c
+#define _GNU_SOURCE
 
 /*=============================================================================
 * includes, defines, usings
 =============================================================================*/
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include "affinity.h"
+#include "builtins.h"
 #include "commands.h"
+#include "history.h"
+#include "linereader.h"
 #include "signals.h"
+#include "schedpolicy.h"
+#include "spawn.h"
 
 /*=============================================================================
 * classes/structs declarations
@@ -18,41 +30,169 @@
 /*=============================================================================
 * global variables & data structures
 =============================================================================*/
-char _line[CMD_LENGTH_MAX];
-
 
 /*=============================================================================
-* main function
+* input handling
 =============================================================================*/
-int main(int argc, char* argv[])
+static bool isBlankOrComment(const char* line)
 {
+	line += strspn(line, " \t\r");
+	return *line == '\0' || *line == '#';
+}
 
-	setup_signal_handlers();
+/*
+ * runs every line of reader, prompting before each one in interactive mode.
+ * with history, lines are remembered and ! lines recall one. returns the
+ * result of the last command
+ */
+static CommandResult runLines(LineReader* reader, bool prompt, bool history)
+{
+	CommandResult res = SMASH_SUCCESS;
 	while (1) {
-		printf("smash > ");
-		fflush(stdout);
+		if(prompt) {
+			printf("smash > ");
+			fflush(stdout);
+		}
+
+		//whatever the previous line allocated goes at once
+		arenaReset(&line_arena);
+		//scripts never block between commands, so CTRL+C is answered here too
+		handle_pending_signals();
 
-		if(!fgets(_line, CMD_LENGTH_MAX, stdin)) {
+		size_t len;
+		const char* line = nextLine(reader, &len);
+		if(!line) {
 			break;
 		}
+		char* cmd_line = arenaStrndup(&line_arena, line, len);
 
-		char* p = strchr(_line, '\n');
-		if(p) {
-			*p = '\0';
+		//the newline is already gone, so this is an empty line
+		if(len == 0) {
+			continue;
 		}
-
-		if(strcmp(_line, "\n") == 0) {
+		//scripts may have blank lines, comments and a #! line
+		if(!prompt && isBlankOrComment(cmd_line)) {
 			continue;
 		}
 
+		//!! !n and !prefix run the line they recall, which is what is remembered
+		if(history && cmd_line[0] == '!' && cmd_line[1] != '\0') {
+			char* recalled = recallHistory(&line_arena, cmd_line);
+			if(!recalled) {
+				perrorSmash(cmd_line, "event not found");
+				res = SMASH_FAIL;
+				continue;
+			}
+			printf("%s\n", recalled);
+			fflush(stdout);
+			cmd_line = recalled;
+		}
+		if(history) {
+			addHistory(cmd_line);
+		}
 
-		CommandResult res = executeCommand(_line);
+		res = executeCommand(cmd_line);
 		if(res == SMASH_QUIT) {
 			break;
 		}
 	}
+	return res;
+}
 
+static int exitStatus(CommandResult res)
+{
+	return res == SMASH_FAIL ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-	return 0;
+static int runString(char* cmd)
+{
+	size_t len = strlen(cmd);
+	LineReader reader = { .fd = -1, .buf = cmd, .size = len, .end = len, .eof = true };
+	return exitStatus(runLines(&reader, false, false));
+}
+
+static int runScript(const char* path)
+{
+	//a fifo blocks until it has a writer, CTRL+C meanwhile is not a failure
+	int fd;
+	while((fd = my_system_call(SYS_OPEN, path, O_RDONLY, 0)) == -1 && errno == EINTR) {
+	}
+	struct stat st;
+	if(fd == -1 || fstat(fd, &st) != 0) {
+		perrorSmash(path, "cannot open script");
+		return EXIT_FAILURE;
+	}
+
+	LineReader reader = { .fd = fd };
+	char* map = MAP_FAILED;
+	if(S_ISREG(st.st_mode) && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	if(map != MAP_FAILED) {
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		reader.buf = map;
+		reader.size = reader.end = st.st_size;
+		reader.eof = true;
+	} else {
+		//pipes, fifos and empty files are read like stdin, minus the prompt
+		reader.buf = MALLOC_VALIDATED(char, INPUT_BUFFER_SIZE);
+		reader.size = INPUT_BUFFER_SIZE;
+	}
+
+	CommandResult res = runLines(&reader, false, false);
+
+	if(map != MAP_FAILED) {
+		munmap(map, st.st_size);
+	} else {
+		free(reader.buf);
+	}
+	my_system_call(SYS_CLOSE, fd);
+	return exitStatus(res);
+}
+
+static void runInteractive(void)
+{
+	//what is piped in is not typed by anyone, it is neither remembered nor recalled
+	const bool history = isatty(STDIN_FILENO);
+	if(history) {
+		initHistory();
+	}
+
+	LineReader reader = { .fd = STDIN_FILENO, .interactive = true, .size = INPUT_BUFFER_SIZE };
+	reader.buf = MALLOC_VALIDATED(char, reader.size);
+	setShellStdinReader(&reader);
+	runLines(&reader, true, history);
+	setShellStdinReader(NULL);
+	free(reader.buf);
 }
 
+
+/*=============================================================================
+* main function
+=============================================================================*/
+int main(int argc, char* argv[])
+{
+
+	initJobs();
+	initBuiltins();
+	initSpawn();
+	initSchedPolicy();
+	initPlacement();
+	initSyscallStats();
+	setup_signal_handlers();
+
+	//smash -c "cmd" and smash script.smash run without a prompt
+	if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+		if(argc < 3) {
+			perrorSmash("-c", "option requires an argument");
+			return EXIT_FAILURE;
+		}
+		return runString(argv[2]);
+	}
+	if(argc > 1) {
+		return runScript(argv[1]);
+	}
+
+	runInteractive();
+	return 0;
+}
@@ -0,0 +1,233 @@
+//spawn.c
+#define _GNU_SOURCE
+#include "spawn.h"
+#include "commands.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+static SpawnMode spawn_mode = SPAWN_MODE_DEFAULT;
+
+static const char* spawn_mode_names[] = {
+	[SPAWN_FORK] = "fork",
+	[SPAWN_POSIX_SPAWN] = "posix_spawn",
+	[SPAWN_VFORK] = "vfork",
+};
+
+#define SPAWN_MODES_NUM ((int)(sizeof(spawn_mode_names) / sizeof(spawn_mode_names[0])))
+
+void initSpawn(void) {
+	const char* mode = getenv("SMASH_SPAWN");
+	if(mode && !parseSpawnMode(mode, &spawn_mode)) {
+		perrorSmash("SMASH_SPAWN", "invalid value, using default");
+	}
+}
+
+void setSpawnMode(SpawnMode mode) {
+	spawn_mode = mode;
+}
+
+SpawnMode getSpawnMode(void) {
+	return spawn_mode;
+}
+
+bool parseSpawnMode(const char* name, SpawnMode* mode) {
+	for(int i = 0; i < SPAWN_MODES_NUM; i++) {
+		if(strcmp(name, spawn_mode_names[i]) == 0) {
+			*mode = (SpawnMode)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* spawnModeName(SpawnMode mode) {
+	return spawn_mode_names[mode];
+}
+
+static bool isExecError(int err) {
+	return err == ENOENT || err == EACCES || err == ENOEXEC || err == ENOTDIR ||
+		err == ELOOP || err == ENAMETOOLONG || err == EISDIR || err == ETXTBSY;
+}
+
+static void reportSpawnError(const char* cmd_line, int err) {
+	perrorSmash(cmd_line, isExecError(err) ? "execvp failed" : "fork failed");
+}
+
+//child side of fork/vfork, only async-signal-safe calls
+static void placeChild(const SpawnOptions* options) {
+	setpgid(0, options->pgid);
+	if(options->in_fd != -1) {
+		dup2(options->in_fd, STDIN_FILENO);
+	}
+	if(options->out_fd != -1) {
+		dup2(options->out_fd, STDOUT_FILENO);
+	}
+	if(options->policy) {
+		applySchedPolicy(0, options->policy);
+	}
+	if(options->cpus) {
+		sched_setaffinity(0, sizeof(cpu_set_t), &options->cpus->set);
+	}
+}
+
+pid_t forkShell(const char* cmd_line, const SpawnOptions* options) {
+
+	//or the child would print whatever is still buffered a second time
+	fflush(stdout);
+	const pid_t pid = (pid_t)my_system_call(SYS_FORK);
+	if(pid == -1) {
+		perrorSmash(cmd_line, "fork failed");
+		return -1;
+	}
+	if(pid == 0) {
+		placeChild(options);
+		return 0;
+	}
+
+	//also from the parent, so the group exists before we wait on it or join it
+	setpgid(pid, options->pgid ? options->pgid : pid);
+	return pid;
+}
+
+static pid_t spawnFork(const char* path, char* argv[], const char* cmd_line, const SpawnOptions* options) {
+
+	const pid_t pid = forkShell(cmd_line, options);
+	if(pid == 0) {
+		if(path) {
+			my_system_call(SYS_EXECVP, path, argv);
+		}
+		//not cached, or the cached binary vanished under us
+		my_system_call(SYS_EXECVP, argv[0], argv);
+		perrorSmash(cmd_line, "execvp failed");
+		exit(EXIT_FAILURE);
+	}
+	return pid;
+}
+
+static pid_t spawnPosix(const char* path, char* argv[], const char* cmd_line, const SpawnOptions* options) {
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+	//the class is the only part of a policy posix_spawn can set, see spawnCommand()
+	if(options->policy && options->policy->sched != SCHED_KEEP) {
+		struct sched_param param = { .sched_priority = 0 };
+		posix_spawnattr_setschedpolicy(&attr, schedClassPolicy(options->policy->sched));
+		posix_spawnattr_setschedparam(&attr, &param);
+		flags |= POSIX_SPAWN_SETSCHEDULER;
+	}
+	posix_spawnattr_setflags(&attr, flags);
+	posix_spawnattr_setpgroup(&attr, options->pgid);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if(options->in_fd != -1) {
+		posix_spawn_file_actions_adddup2(&actions, options->in_fd, STDIN_FILENO);
+	}
+	if(options->out_fd != -1) {
+		posix_spawn_file_actions_adddup2(&actions, options->out_fd, STDOUT_FILENO);
+	}
+
+	//the shell catches these, the child must start with default handlers
+	sigset_t defaults;
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGINT);
+	sigaddset(&defaults, SIGTSTP);
+	sigaddset(&defaults, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+
+	pid_t pid;
+	int err = ENOENT;
+	if(path) {
+		err = TIMED_SYSCALL(SYS_FORK, posix_spawn(&pid, path, &actions, &attr, argv, environ));
+	}
+	if(err == ENOENT) {
+		err = TIMED_SYSCALL(SYS_FORK, posix_spawnp(&pid, argv[0], &actions, &attr, argv, environ));
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if(err != 0) {
+		reportSpawnError(cmd_line, err);
+		return -1;
+	}
+	return pid;
+}
+
+static pid_t spawnVfork(const char* path, char* argv[], const char* cmd_line, const SpawnOptions* options) {
+
+	//the child shares our memory until exec, so it reports failures through it
+	volatile int exec_errno = 0;
+
+	//no handler of ours may run on the borrowed stack
+	sigset_t all, old;
+	sigfillset(&all);
+	sigprocmask(SIG_SETMASK, &all, &old);
+
+	//timed by hand, the child may not return into the stats code
+	if(syscall_stats_enabled) {
+		syscallStatsStart();
+	}
+	const pid_t pid = vfork();
+	if(pid == 0) {
+		placeChild(options);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		sigprocmask(SIG_SETMASK, &old, NULL);
+
+		if(path) {
+			execv(path, argv);
+		}
+		execvp(argv[0], argv);
+		exec_errno = errno;
+		_exit(EXIT_FAILURE);
+	}
+
+	int err = errno;
+	if(syscall_stats_enabled) {
+		syscallStatsEnd(SYS_FORK, pid);
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+
+	if(pid == -1) {
+		reportSpawnError(cmd_line, err);
+		return -1;
+	}
+	if(exec_errno != 0) {
+		int status;
+		while(my_system_call(SYS_WAITPID, pid, &status, 0) == -1 && errno == EINTR) {
+		}
+		reportSpawnError(cmd_line, exec_errno);
+		return -1;
+	}
+	return pid;
+}
+
+//nice, the i/o priority and cpus can only be set by the child itself before exec
+static bool needsPlacedChild(const SpawnOptions* options) {
+	const SchedPolicy* policy = options->policy;
+	return options->cpus || (policy && (policy->nice != SCHED_KEEP || policy->io_class != SCHED_KEEP));
+}
+
+pid_t spawnCommand(const char* path, char* argv[], const char* cmd_line, const SpawnOptions* options) {
+	switch(spawn_mode) {
+		case SPAWN_POSIX_SPAWN:
+			if(needsPlacedChild(options)) {
+				return spawnVfork(path, argv, cmd_line, options);
+			}
+			return spawnPosix(path, argv, cmd_line, options);
+		case SPAWN_VFORK:
+			return spawnVfork(path, argv, cmd_line, options);
+		case SPAWN_FORK:
+		default:
+			return spawnFork(path, argv, cmd_line, options);
+	}
+}
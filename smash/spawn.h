@@ -0,0 +1,65 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "affinity.h"
+#include "schedpolicy.h"
+
+/*=============================================================================
+* process creation for external commands
+*
+* SPAWN_FORK        - fork + setpgid + execvp, copies the shell's page tables
+* SPAWN_POSIX_SPAWN - posix_spawn with POSIX_SPAWN_SETPGROUP, no page table copy.
+*                     a nice, i/o priority or cpus to set go through vfork
+*                     instead, posix_spawn cannot set them before exec
+* SPAWN_VFORK       - vfork, the child borrows the shell's memory until exec
+* all modes put the child in its own process group, like before.
+=============================================================================*/
+typedef enum {
+    SPAWN_FORK,
+    SPAWN_POSIX_SPAWN,
+    SPAWN_VFORK
+} SpawnMode;
+
+#define SPAWN_MODE_DEFAULT SPAWN_POSIX_SPAWN
+
+//where a new process goes, used to wire up pipeline stages
+typedef struct {
+    pid_t pgid;  //process group to join, 0 to lead a new one
+    int in_fd;   //becomes stdin, -1 to inherit
+    int out_fd;  //becomes stdout, -1 to inherit
+    const SchedPolicy* policy; //applied before exec, NULL to inherit the shell's
+    const CpuSet* cpus;        //pinned to before exec, NULL to inherit the shell's
+} SpawnOptions;
+
+#define SPAWN_OPTIONS_DEFAULT { .pgid = 0, .in_fd = -1, .out_fd = -1, .policy = NULL, .cpus = NULL }
+
+/*
+ * reads the mode from the SMASH_SPAWN environment variable, if set
+ */
+void initSpawn(void);
+void setSpawnMode(SpawnMode mode);
+SpawnMode getSpawnMode(void);
+bool parseSpawnMode(const char* name, SpawnMode* mode);
+const char* spawnModeName(SpawnMode mode);
+
+/*
+ * starts argv in the process group and with the stdin/stdout given by
+ * options. path is the cached absolute path of argv[0], or NULL to search
+ * PATH. returns the child pid, or -1 after reporting the error against
+ * cmd_line. in fork mode exec failures are reported by the child itself,
+ * which then exits with EXIT_FAILURE.
+ */
+pid_t spawnCommand(const char* path, char* argv[], const char* cmd_line, const SpawnOptions* options);
+
+/*
+ * forks the shell itself (for builtins), the child comes back already in
+ * place according to options. same return values as fork.
+ */
+pid_t forkShell(const char* cmd_line, const SpawnOptions* options);
+
+#endif //SPAWN_H
@@ -0,0 +1,125 @@
+//syscallstats.c
+#define _GNU_SOURCE
+#include "syscallstats.h"
+#include "commands.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define BUCKETS_NUM ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[BUCKETS_NUM];
+} SyscallStats;
+
+bool syscall_stats_enabled = false;
+
+//updated atomically, diff may run off the main thread
+static SyscallStats stats[SYSCALLS_NUM];
+static __thread struct timespec call_start;
+
+static const char* syscall_names[SYSCALLS_NUM] = {
+	[SYS_FORK] = "fork",
+	[SYS_EXECVP] = "execvp",
+	[SYS_WAITPID] = "waitpid",
+	[SYS_SIGNAL] = "signal",
+	[SYS_KILL] = "kill",
+	[SYS_PIPE] = "pipe",
+	[SYS_READ] = "read",
+	[SYS_WRITE] = "write",
+	[SYS_OPEN] = "open",
+	[SYS_CLOSE] = "close",
+};
+
+void initSyscallStats(void) {
+	const char* env = getenv("SMASH_STATS");
+	if(env && strcmp(env, "1") == 0) {
+		setSyscallStats(true);
+	}
+}
+
+void setSyscallStats(bool enabled) {
+	syscall_stats_enabled = enabled;
+}
+
+static unsigned bucketOf(uint64_t ns) {
+	if(ns < SUB_BUCKETS) {
+		return ns;
+	}
+	int exp = 63 - __builtin_clzll(ns);
+	return (exp - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + ((ns >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+//middle of the range of values bucket holds
+static uint64_t bucketValue(unsigned bucket) {
+	if(bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	int exp = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+	uint64_t width = 1ULL << (exp - SUB_BUCKET_BITS);
+	return (SUB_BUCKETS + bucket % SUB_BUCKETS) * width + width / 2;
+}
+
+void syscallStatsStart(void) {
+	clock_gettime(CLOCK_MONOTONIC, &call_start);
+}
+
+long syscallStatsEnd(int number, long result) {
+	int saved_errno = errno;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if(number > 0 && number < SYSCALLS_NUM) {
+		uint64_t ns = (end.tv_sec - call_start.tv_sec) * 1000000000ULL + end.tv_nsec - call_start.tv_nsec;
+		SyscallStats* s = &stats[number];
+		__atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&s->total_ns, ns, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&s->buckets[bucketOf(ns)], 1, __ATOMIC_RELAXED);
+
+		uint64_t max = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+		while(ns > max && !__atomic_compare_exchange_n(&s->max_ns, &max, ns, true,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		}
+	}
+
+	errno = saved_errno;
+	return result;
+}
+
+static double percentileUs(const SyscallStats* s, int p) {
+	uint64_t rank = (p * s->count + 99) / 100;
+	uint64_t seen = 0;
+	for(unsigned b = 0; b < BUCKETS_NUM; b++) {
+		seen += s->buckets[b];
+		if(seen >= rank && seen > 0) {
+			uint64_t ns = bucketValue(b);
+			return (ns < s->max_ns ? ns : s->max_ns) / 1000.0;
+		}
+	}
+	return s->max_ns / 1000.0;
+}
+
+void printSyscallStats(void) {
+	printf("%-8s %10s %12s %10s %10s %10s %10s\n",
+		"syscall", "calls", "total ms", "p50 us", "p90 us", "p99 us", "max us");
+	for(int i = 1; i < SYSCALLS_NUM; i++) {
+		const SyscallStats* s = &stats[i];
+		if(s->count == 0) {
+			continue;
+		}
+		printf("%-8s %10llu %12.3f %10.1f %10.1f %10.1f %10.1f\n", syscall_names[i],
+			(unsigned long long)s->count, s->total_ns / 1000000.0,
+			percentileUs(s, 50), percentileUs(s, 90), percentileUs(s, 99), s->max_ns / 1000.0);
+	}
+}
+
+void resetSyscallStats(void) {
+	memset(stats, 0, sizeof(stats));
+}
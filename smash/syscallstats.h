@@ -0,0 +1,47 @@
+#ifndef SYSCALLSTATS_H
+#define SYSCALLSTATS_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+
+#include "my_system_call.h"
+
+//one past the largest SYS_* number
+#define SYSCALLS_NUM (SYS_CLOSE + 1)
+
+/*=============================================================================
+* syscall instrumentation
+*
+* this header wraps my_system_call() so that, while stats are enabled, every
+* call is counted and timed under its SYS_* number. calls made directly
+* (wait4, posix_spawn) are wrapped with TIMED_SYSCALL under the number of the
+* call they stand in for. disabled, the cost is one test of a global flag.
+* latencies go to log-linear histograms, 8 linear buckets per power of two
+* nanoseconds, so percentiles are within 12.5%. signal handlers must call
+* the real function, (my_system_call)(...), they would clobber the timing.
+=============================================================================*/
+extern bool syscall_stats_enabled;
+
+/*
+ * enables stats if the SMASH_STATS environment variable is set to 1
+ */
+void initSyscallStats(void);
+void setSyscallStats(bool enabled);
+void syscallStatsStart(void);
+long syscallStatsEnd(int number, long result);
+
+void printSyscallStats(void);
+void resetSyscallStats(void);
+
+#define TIMED_SYSCALL(number, call) \
+    (syscall_stats_enabled ? syscallStatsEnd((number), (syscallStatsStart(), (long)(call))) : (long)(call))
+
+#define SYSCALL_NUMBER(...) SYSCALL_NUMBER_(__VA_ARGS__, 0)
+#define SYSCALL_NUMBER_(number, ...) number
+
+//the parenthesized name is the real function, not this macro
+#define my_system_call(...) \
+    TIMED_SYSCALL(SYSCALL_NUMBER(__VA_ARGS__), (my_system_call)(__VA_ARGS__))
+
+#endif //SYSCALLSTATS_H
@@ -0,0 +1,142 @@
+//threadpool.c
+#define _GNU_SOURCE
+#include "threadpool.h"
+#include "signals.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static ThreadTask* queue_head = NULL;
+static ThreadTask* queue_tail = NULL;
+static int workers_num = 0;
+
+//set by the workers, cleared by consumeFinishedTasks()
+static int tasks_finished = 0;
+
+static ThreadTask* popTask(void) {
+	pthread_mutex_lock(&queue_lock);
+	while(queue_head == NULL) {
+		pthread_cond_wait(&queue_ready, &queue_lock);
+	}
+	ThreadTask* task = queue_head;
+	queue_head = task->next;
+	if(queue_head == NULL) {
+		queue_tail = NULL;
+	}
+	pthread_mutex_unlock(&queue_lock);
+	return task;
+}
+
+//usage = after - before, except max rss which is per process anyway
+static void usageDelta(struct rusage* usage, const struct rusage* before, const struct rusage* after) {
+	memset(usage, 0, sizeof(*usage));
+	timersub(&after->ru_utime, &before->ru_utime, &usage->ru_utime);
+	timersub(&after->ru_stime, &before->ru_stime, &usage->ru_stime);
+	usage->ru_maxrss = after->ru_maxrss;
+	usage->ru_nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+	usage->ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+}
+
+static void* worker(void* arg) {
+	(void)arg;
+	while(1) {
+		ThreadTask* task = popTask();
+
+		struct rusage before, after;
+		getrusage(RUSAGE_THREAD, &before);
+		task->result = task->handler(task->argc, task->argv);
+		getrusage(RUSAGE_THREAD, &after);
+		usageDelta(&task->usage, &before, &after);
+		fflush(stdout);
+
+		__atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&tasks_finished, 1, __ATOMIC_RELEASE);
+		wake_main_loop();
+	}
+	return NULL;
+}
+
+static bool startWorkers(void) {
+
+	//the workers inherit a mask that keeps every signal on the main thread
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while(workers_num < THREAD_POOL_SIZE) {
+		pthread_t tid;
+		if(pthread_create(&tid, &attr, worker, NULL) != 0) {
+			break;
+		}
+		workers_num++;
+	}
+	pthread_attr_destroy(&attr);
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return workers_num > 0;
+}
+
+//argv and its strings in a single block
+static char** copyArgv(int argc, char* argv[]) {
+	size_t size = (argc + 1) * sizeof(char*);
+	for(int i = 0; i < argc; i++) {
+		size += strlen(argv[i]) + 1;
+	}
+
+	char** copy = MALLOC_VALIDATED(char*, size);
+	char* strings = (char*)(copy + argc + 1);
+	for(int i = 0; i < argc; i++) {
+		size_t len = strlen(argv[i]) + 1;
+		memcpy(strings, argv[i], len);
+		copy[i] = strings;
+		strings += len;
+	}
+	copy[argc] = NULL;
+	return copy;
+}
+
+ThreadTask* submitTask(TaskHandler handler, int argc, char* argv[]) {
+	if(workers_num == 0 && !startWorkers()) {
+		return NULL;
+	}
+
+	ThreadTask* task = MALLOC_VALIDATED(ThreadTask, sizeof(ThreadTask));
+	memset(task, 0, sizeof(*task));
+	task->handler = handler;
+	task->argc = argc;
+	task->argv = copyArgv(argc, argv);
+
+	//or the worker's output would come before what the shell already printed
+	fflush(stdout);
+
+	pthread_mutex_lock(&queue_lock);
+	if(queue_tail) {
+		queue_tail->next = task;
+	} else {
+		queue_head = task;
+	}
+	queue_tail = task;
+	pthread_cond_signal(&queue_ready);
+	pthread_mutex_unlock(&queue_lock);
+	return task;
+}
+
+bool isTaskDone(const ThreadTask* task) {
+	return __atomic_load_n(&task->done, __ATOMIC_ACQUIRE);
+}
+
+void freeTask(ThreadTask* task) {
+	free(task->argv);
+	free(task);
+}
+
+bool consumeFinishedTasks(void) {
+	return __atomic_exchange_n(&tasks_finished, 0, __ATOMIC_ACQ_REL);
+}
@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+/*=============================================================================
+* includes, defines, usings
+=============================================================================*/
+#include <stdbool.h>
+#include <sys/resource.h>
+
+#include "commands.h"
+
+//workers started on the first submit, tasks beyond that wait in line
+#define THREAD_POOL_SIZE 4
+
+/*=============================================================================
+* worker threads for backgrounded builtins
+*
+* a builtin flagged thread safe that is run with & does not fork the shell,
+* it is handed to a small pool of threads instead. the workers block every
+* signal, so CTRL+C, CTRL+Z and SIGCHLD keep reaching the main thread. a
+* finished task only raises a flag and wakes the main loop through the
+* signal pipe, the job table itself is only ever touched by the main thread.
+=============================================================================*/
+typedef CommandResult (*TaskHandler)(int argc, char* argv[]);
+
+typedef struct ThreadTask {
+	TaskHandler handler;
+	int argc;
+	char** argv;          //private copy, the line it came from goes away
+	CommandResult result;
+	struct rusage usage;  //what the worker used running it
+	int done;             //set by the worker once result and usage are final
+	struct ThreadTask* next;
+} ThreadTask;
+
+/*
+ * queues handler(argc, argv) for a worker. returns NULL if the pool could not
+ * be started, the caller then runs the builtin some other way
+ */
+ThreadTask* submitTask(TaskHandler handler, int argc, char* argv[]);
+
+bool isTaskDone(const ThreadTask* task);
+
+/*
+ * only once the task is done
+ */
+void freeTask(ThreadTask* task);
+
+/*
+ * returns true once per batch of tasks finished since the last call
+ */
+bool consumeFinishedTasks(void);
+
+#endif //THREADPOOL_H